@@ -0,0 +1,68 @@
+#!/bin/sh
+# Batch execution: compiles COUNT generated programs (bench/plgen.c, one
+# seed each) and times running all of them with one vm process per program
+# against a single "vm --batch" run, checking that both leave the same
+# output files. The batch list also holds a malformed image, which must
+# fail on its own without touching the others' output. The batch summary
+# line (instructions/sec, steals) follows.
+#
+# Usage: bench/batch.sh [count] [size] [runs]   (from the repository root,
+#        default 500, 2K and 3)
+
+set -e
+ROOT=$(cd "$(dirname "$0")/.." && pwd)
+WORK=$(mktemp -d)
+trap 'rm -rf "$WORK"' EXIT
+. "$ROOT/bench/common.sh"
+COUNT=${1:-500}
+SIZE=${2:-2K}
+RUNS=${3:-3}
+
+gcc -O2 -std=c11 $LIMITS -o "$WORK/lex" "$ROOT/lex.c"
+gcc -O2 -std=c11 $LIMITS -o "$WORK/parsercodegen" "$ROOT/parsercodegen.c"
+gcc -O2 -std=c11 -pthread -o "$WORK/vm" "$ROOT/vm.c"
+gcc -O2 -std=c11 -o "$WORK/plgen" "$ROOT/bench/plgen.c"
+
+cd "$WORK"
+mkdir programs
+
+# STO far past the stack: a runtime error that ends only this program
+printf '6 0 3\n1 0 5\n4 0 500000\n9 0 3\n' > bad.elf
+echo "bad.elf /dev/null bad.batch" > list.txt
+i=1
+while [ $i -le "$COUNT" ]; do
+    ./plgen --size "$SIZE" --seed "$i" > program.txt
+    ./lex program.txt > /dev/null
+    ./parsercodegen > /dev/null
+    mv elf.txt "programs/p$i.elf"
+    echo "programs/p$i.elf /dev/null programs/p$i.batch" >> list.txt
+    i=$((i + 1))
+done
+
+cat > single.sh << 'EOF'
+for f in programs/*.elf; do ./vm "$f" > "${f%.elf}.single"; done
+EOF
+sh single.sh
+if ./vm --batch list.txt > batch.txt; then
+    echo "Error: --batch did not report bad.elf's failure" >&2
+    exit 1
+fi
+if ! grep -q "^bad.elf .*error .*Address out of range" batch.txt ||
+   ! grep -q "failed 1," batch.txt; then
+    echo "Error: --batch should fail bad.elf and only bad.elf" >&2
+    exit 1
+fi
+for f in programs/*.elf; do
+    if ! cmp -s "${f%.elf}.single" "${f%.elf}.batch"; then
+        echo "Error: --batch output differs for $f" >&2
+        exit 1
+    fi
+done
+
+single_time=$(wall "sh single.sh")
+# Exits 1 for bad.elf, checked above
+batch_time=$(wall "./vm --batch list.txt || true")
+printf "%-22s %10s\n" "one process each" "$single_time"
+printf "%-22s %10s\n" "--batch" "$batch_time"
+echo "speedup $(echo "$single_time $batch_time" | awk '{ printf "%.1fx", $1 / $2 }')"
+tail -n 1 batch.txt
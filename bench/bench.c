@@ -0,0 +1,342 @@
+/*
+Assignment:
+HW3 - Benchmark harness for lex and parsercodegen
+Author(s): Jacob Smith, Jakson Zapata
+Language: C (only)
+
+To Compile:
+gcc -O2 -std=c11 -o bench bench/bench.c
+
+To Execute (on Eustis):
+./bench [--bin <dir>] [--work <dir>] [--sizes <list>] [--runs <n>] [--max-tokens <n>] [--perf] [-- <plgen options>]
+
+where:
+<dir> for --bin holds the lex, parsercodegen and plgen binaries (default .)
+<dir> for --work is where programs, tokens.txt and elf.txt go (default .)
+<list> is a comma separated list of sizes (default 1K,10K,100K,1M,10M,100M)
+<n> for --runs is the number of timed runs per size; the fastest is reported
+<n> for --max-tokens is the MAX_TOKENS lex was built with (default 1000)
+
+Notes:
+- For every size a program is generated with plgen, then lex and
+  parsercodegen run on it as separate processes with their listings sent
+  to /dev/null
+- Prints one JSON object per size on stdout: tokens, instructions, wall
+  time, exit status and peak RSS of each stage, tokens/sec for lex and
+  instructions/sec for parsercodegen
+- lex and parsercodegen run with --stats=json; each stage object embeds
+  the JSON they print (per-phase times, token counts, probe lengths)
+  from the fastest run
+- --perf passes --perf to both, so the embedded objects also carry
+  hardware counters (cycles, instructions, IPC, branch, L1d and LLC
+  misses) per phase, per token and, for parsercodegen, per instruction
+  generated; see perfcount.h. Where the counters are unavailable the
+  object says why and the timings are unaffected
+- lex stops storing tokens once its table of MAX_TOKENS is full and
+  still exits 0, so a run that wrote --max-tokens tokens is not recorded:
+  that size is scanned again with lex --stream, which keeps no table, and
+  the object says "lex_stream": true
+- A stage that fails (exit status != 0, e.g. a table overflow) is
+  reported with its status and the rates are 0
+- bench/run.sh builds everything with raised table sizes and runs this
+
+Class: COP3402 - System Software - Fall 2025
+Instructor: Dr. Jie Lin
+Due Date: Friday, October 31, 2025 at 11:59 PM ET
+*/
+
+#define _POSIX_C_SOURCE 200809L
+#define _DEFAULT_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <sys/time.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+
+#define MAX_SIZES 32
+#define MAX_ARGS 64
+#define PATH_LEN 4096
+
+// Result of one child process
+typedef struct
+{
+    int status;       // exit status, 128 + signal if killed
+    double seconds;   // wall time
+    long peak_rss_kb; // ru_maxrss of the child
+} stage_result;
+
+// Function prototypes
+double now_seconds();
+stage_result run_stage(char *const argv[], const char *dir, const char *stdout_path, const char *stderr_path);
+stage_result best_of(int runs, char *const argv[], const char *dir, const char *stdout_path, const char *stderr_path);
+long count_tokens(const char *path);
+long count_lines(const char *path);
+void print_stage(const char *name, stage_result r, const char *stats_path);
+
+// Main function
+int main(int argc, char *argv[])
+{
+    const char *bin = ".";
+    const char *work = ".";
+    char sizes_arg[PATH_LEN] = "1K,10K,100K,1M,10M,100M";
+    int runs = 1;
+    long max_tokens = 1000;
+    int perf = 0;
+    char *gen_options[MAX_ARGS];
+    int num_gen_options = 0;
+
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "--") == 0)
+        {
+            while (++i < argc && num_gen_options < MAX_ARGS - 8)
+                gen_options[num_gen_options++] = argv[i];
+        }
+        else if (strcmp(argv[i], "--bin") == 0 && i + 1 < argc)
+            bin = argv[++i];
+        else if (strcmp(argv[i], "--work") == 0 && i + 1 < argc)
+            work = argv[++i];
+        else if (strcmp(argv[i], "--sizes") == 0 && i + 1 < argc)
+            snprintf(sizes_arg, sizeof sizes_arg, "%s", argv[++i]);
+        else if (strcmp(argv[i], "--runs") == 0 && i + 1 < argc)
+            runs = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--max-tokens") == 0 && i + 1 < argc)
+            max_tokens = atol(argv[++i]);
+        else if (strcmp(argv[i], "--perf") == 0)
+            perf = 1;
+        else
+        {
+            fprintf(stderr, "Usage: ./bench [--bin <dir>] [--work <dir>] [--sizes <list>] [--runs <n>] [--max-tokens <n>] [--perf] [-- <plgen options>]\n");
+            return 1;
+        }
+    }
+    if (runs < 1)
+        runs = 1;
+
+    char lex_path[PATH_LEN], pcg_path[PATH_LEN], gen_path[PATH_LEN];
+    snprintf(lex_path, sizeof lex_path, "%s/lex", bin);
+    snprintf(pcg_path, sizeof pcg_path, "%s/parsercodegen", bin);
+    snprintf(gen_path, sizeof gen_path, "%s/plgen", bin);
+
+    char *size_list[MAX_SIZES];
+    int num_sizes = 0;
+    for (char *tok = strtok(sizes_arg, ","); tok != NULL && num_sizes < MAX_SIZES; tok = strtok(NULL, ","))
+        size_list[num_sizes++] = tok;
+
+    for (int s = 0; s < num_sizes; s++)
+    {
+        char program[PATH_LEN], tokens[PATH_LEN], elf[PATH_LEN], lex_stats[PATH_LEN], pcg_stats[PATH_LEN];
+        snprintf(program, sizeof program, "%s/bench_%s.txt", work, size_list[s]);
+        snprintf(tokens, sizeof tokens, "%s/tokens.txt", work);
+        snprintf(elf, sizeof elf, "%s/elf.txt", work);
+        snprintf(lex_stats, sizeof lex_stats, "%s/lex.stats.json", work);
+        snprintf(pcg_stats, sizeof pcg_stats, "%s/parsercodegen.stats.json", work);
+
+        // plgen --size <size> <plgen options> > program
+        char *gen_argv[MAX_ARGS];
+        int n = 0;
+        gen_argv[n++] = gen_path;
+        gen_argv[n++] = "--size";
+        gen_argv[n++] = size_list[s];
+        for (int i = 0; i < num_gen_options; i++)
+            gen_argv[n++] = gen_options[i];
+        gen_argv[n] = NULL;
+
+        stage_result gen = run_stage(gen_argv, NULL, program, NULL);
+        if (gen.status != 0)
+        {
+            fprintf(stderr, "Error: plgen failed for size %s\n", size_list[s]);
+            return 1;
+        }
+
+        char *lex_argv[] = {lex_path, "--stats=json", program, NULL, NULL, NULL};
+        char *pcg_argv[] = {pcg_path, "--stats=json", NULL, NULL};
+        if (perf)
+        {
+            lex_argv[2] = "--perf";
+            lex_argv[3] = program;
+            pcg_argv[2] = "--perf";
+        }
+        stage_result lex = best_of(runs, lex_argv, work, "/dev/null", lex_stats);
+        long num_tokens = lex.status == 0 ? count_tokens(tokens) : 0;
+
+        // A full token table means tokens.txt was cut short
+        int lex_stream = 0;
+        if (lex.status == 0 && num_tokens >= max_tokens)
+        {
+            fprintf(stderr, "Note: lex filled its %ld token table for size %s, scanning again with --stream\n",
+                    max_tokens, size_list[s]);
+            memmove(&lex_argv[2], &lex_argv[1], 3 * sizeof lex_argv[0]);
+            lex_argv[1] = "--stream";
+            lex = best_of(runs, lex_argv, work, "/dev/null", lex_stats);
+            num_tokens = lex.status == 0 ? count_tokens(tokens) : 0;
+            lex_stream = 1;
+        }
+        stage_result pcg = best_of(runs, pcg_argv, work, "/dev/null", pcg_stats);
+        long num_instructions = pcg.status == 0 ? count_lines(elf) : 0;
+
+        FILE *f = fopen(program, "rb");
+        long bytes = 0;
+        if (f != NULL)
+        {
+            fseek(f, 0, SEEK_END);
+            bytes = ftell(f);
+            fclose(f);
+        }
+
+        printf("{\"size\": \"%s\", \"source_bytes\": %ld, \"tokens\": %ld, \"instructions\": %ld, \"lex_stream\": %s, ",
+               size_list[s], bytes, num_tokens, num_instructions, lex_stream ? "true" : "false");
+        print_stage("lex", lex, lex_stats);
+        printf(", ");
+        print_stage("parsercodegen", pcg, pcg_stats);
+        printf(", \"tokens_per_sec\": %.0f, \"instructions_per_sec\": %.0f}\n",
+               lex.status == 0 && lex.seconds > 0 ? num_tokens / lex.seconds : 0.0,
+               pcg.status == 0 && pcg.seconds > 0 ? num_instructions / pcg.seconds : 0.0);
+        fflush(stdout);
+
+        remove(program);
+        remove(lex_stats);
+        remove(pcg_stats);
+    }
+
+    return 0;
+}
+
+double now_seconds()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// Run argv in dir with stdout (and stderr unless NULL) redirected, timing
+// it and collecting rusage
+stage_result run_stage(char *const argv[], const char *dir, const char *stdout_path, const char *stderr_path)
+{
+    stage_result r = {-1, 0.0, 0};
+    double start = now_seconds();
+
+    pid_t pid = fork();
+    if (pid < 0)
+        return r;
+    if (pid == 0)
+    {
+        int fd = open(stdout_path, O_WRONLY | O_CREAT | O_TRUNC, 0666);
+        if (fd < 0 || dup2(fd, STDOUT_FILENO) < 0 || (dir != NULL && chdir(dir) != 0))
+            _exit(127);
+        close(fd);
+        if (stderr_path != NULL)
+        {
+            fd = open(stderr_path, O_WRONLY | O_CREAT | O_TRUNC, 0666);
+            if (fd < 0 || dup2(fd, STDERR_FILENO) < 0)
+                _exit(127);
+            close(fd);
+        }
+        execv(argv[0], argv);
+        _exit(127);
+    }
+
+    int status;
+    struct rusage usage;
+    if (wait4(pid, &status, 0, &usage) < 0)
+        return r;
+
+    r.seconds = now_seconds() - start;
+    r.peak_rss_kb = usage.ru_maxrss;
+    if (WIFEXITED(status))
+        r.status = WEXITSTATUS(status);
+    else if (WIFSIGNALED(status))
+        r.status = 128 + WTERMSIG(status);
+    return r;
+}
+
+// Fastest of several runs (peak RSS is the largest seen); stderr_path
+// keeps the output of the fastest run
+stage_result best_of(int runs, char *const argv[], const char *dir, const char *stdout_path, const char *stderr_path)
+{
+    char scratch[PATH_LEN];
+    snprintf(scratch, sizeof scratch, "%s.run", stderr_path);
+
+    stage_result best = run_stage(argv, dir, stdout_path, stderr_path);
+    for (int i = 1; i < runs && best.status == 0; i++)
+    {
+        stage_result r = run_stage(argv, dir, stdout_path, scratch);
+        if (r.peak_rss_kb > best.peak_rss_kb)
+            best.peak_rss_kb = r.peak_rss_kb;
+        if (r.status == 0 && r.seconds < best.seconds)
+        {
+            best.seconds = r.seconds;
+            rename(scratch, stderr_path);
+        }
+    }
+    remove(scratch);
+    return best;
+}
+
+// tokens.txt is "type [lexeme]" words; identsym (2) and numbersym (3) carry one
+long count_tokens(const char *path)
+{
+    FILE *f = fopen(path, "r");
+    if (f == NULL)
+        return 0;
+
+    long count = 0;
+    char word[512];
+    int skip_next = 0;
+    while (fscanf(f, "%511s", word) == 1)
+    {
+        if (skip_next)
+        {
+            skip_next = 0;
+            continue;
+        }
+        count++;
+        skip_next = strcmp(word, "2") == 0 || strcmp(word, "3") == 0;
+    }
+    fclose(f);
+    return count;
+}
+
+long count_lines(const char *path)
+{
+    FILE *f = fopen(path, "r");
+    if (f == NULL)
+        return 0;
+
+    long count = 0;
+    int ch;
+    while ((ch = fgetc(f)) != EOF)
+        count += ch == '\n';
+    fclose(f);
+    return count;
+}
+
+// Stage timings plus the --stats=json line the stage printed, if any
+void print_stage(const char *name, stage_result r, const char *stats_path)
+{
+    printf("\"%s\": {\"status\": %d, \"seconds\": %.6f, \"peak_rss_kb\": %ld",
+           name, r.status, r.seconds, r.peak_rss_kb);
+
+    FILE *f = r.status == 0 ? fopen(stats_path, "r") : NULL;
+    if (f != NULL)
+    {
+        static char line[65536];
+        while (fgets(line, sizeof line, f) != NULL)
+        {
+            if (line[0] == '{')
+            {
+                line[strcspn(line, "\n")] = '\0';
+                printf(", \"stats\": %s", line);
+                break;
+            }
+        }
+        fclose(f);
+    }
+    printf("}");
+}
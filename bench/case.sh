@@ -0,0 +1,87 @@
+#!/bin/sh
+# Multiway branches: the same dispatch over LABELS labels written as a case
+# statement and as the if ... fi chain it replaces, once with dense labels
+# (0, 1, 2, ...: a jump table) and once with sparse ones (0, 37, 74, ...:
+# a binary search). Checks that each pair prints the same and reports
+# instructions executed (vm --count) and the fastest wall time.
+#
+# Usage: bench/case.sh [labels] [runs]   (from the repository root,
+#        default 16 and 3)
+
+set -e
+ROOT=$(cd "$(dirname "$0")/.." && pwd)
+WORK=$(mktemp -d)
+trap 'rm -rf "$WORK"' EXIT
+. "$ROOT/bench/common.sh"
+LABELS=${1:-16}
+RUNS=${2:-3}
+
+gcc -O2 -std=c11 -o "$WORK/lex" "$ROOT/lex.c"
+gcc -O2 -std=c11 -DMAX_CODE_LENGTH=100000 -o "$WORK/parsercodegen" "$ROOT/parsercodegen.c"
+gcc -O2 -std=c11 -pthread -o "$WORK/vm" "$ROOT/vm.c"
+cd "$WORK"
+
+# program <name> <stride> <case|if>: 2000 x 1000 loop dispatching on
+# s = stride * (j mod LABELS) into <name>.elf
+program() {
+    {
+        echo "var i, j, s, x;"
+        echo "begin"
+        echo "  i := 0; x := 0;"
+        echo "  while i < 2000 do"
+        echo "  begin"
+        echo "    j := 0;"
+        echo "    while j < 1000 do"
+        echo "    begin"
+        echo "      s := (j - j / $LABELS * $LABELS) * $2;"
+        awk -v n="$LABELS" -v stride="$2" -v form="$3" 'BEGIN {
+            if (form == "case")
+            {
+                printf "      case s of\n"
+                for (k = 0; k < n; k++)
+                    printf "        %d then x := x + %d%s\n", k * stride, k + 1, k < n - 1 ? ";" : ""
+                printf "      end;\n"
+            }
+            else
+            {
+                for (k = 0; k < n; k++)
+                    printf "      if s = %d then x := x + %d fi;\n", k * stride, k + 1
+            }
+        }'
+        echo "      j := j + 1"
+        echo "    end;"
+        echo "    i := i + 1"
+        echo "  end;"
+        echo "  write x"
+        echo "end."
+    } > "$1.txt"
+    ./lex "$1.txt" > /dev/null
+    ./parsercodegen > /dev/null
+    mv elf.txt "$1.elf"
+}
+
+# count <elf>: instructions executed
+count() {
+    ./vm --count "$1" 2>&1 > /dev/null | awk '{ print $3 }'
+}
+
+printf "%-7s %12s %12s %10s %10s %8s\n" "labels" "if chain" "case" "if chain" "case" "speedup"
+for kind in dense sparse; do
+    stride=1
+    [ "$kind" = sparse ] && stride=37
+    program "$kind.if" "$stride" if
+    program "$kind.case" "$stride" case
+
+    ./vm "$kind.if.elf" > if.out
+    ./vm "$kind.case.elf" > case.out
+    if ! cmp -s if.out case.out; then
+        echo "Error: case and if chain differ for $kind labels" >&2
+        exit 1
+    fi
+
+    if_time=$(wall "./vm $kind.if.elf")
+    case_time=$(wall "./vm $kind.case.elf")
+    printf "%-7s %12s %12s %10s %10s %8s\n" "$kind" "$(count "$kind.if.elf")" "$(count "$kind.case.elf")" \
+        "$if_time" "$case_time" \
+        "$(echo "$if_time $case_time" | awk '{ printf "%.2fx", $1 / $2 }')"
+done
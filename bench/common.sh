@@ -0,0 +1,24 @@
+# Helpers shared by the bench/*.sh scripts, which source this file once
+# ROOT is set. Not meant to be run on its own.
+
+# Table sizes for generated programs up to bench/run.sh's largest, 100M.
+# lex keeps every token in memory (about 320 bytes each), too much for the
+# 24M tokens of 100M; bench scans inputs that fill MAX_TOKENS again with
+# lex --stream. parsercodegen holds all of 100M's 18M instructions
+MAX_TOKENS=4000000
+LIMITS="-DMAX_SOURCE_SIZE=134217728 -DMAX_TOKENS=$MAX_TOKENS -DMAX_CODE_LENGTH=32000000 -DMAX_SYMBOL_TABLE_SIZE=100000"
+
+# wall <command>: fastest wall time over RUNS runs of a shell command. The
+# body is a subshell so its counters never clobber the caller's variables
+wall() (
+    i=0
+    min=
+    while [ $i -lt "$RUNS" ]; do
+        s=$(date +%s.%N)
+        sh -c "$1" > /dev/null
+        t=$(echo "$s $(date +%s.%N)" | awk '{ print $2 - $1 }')
+        min=$(echo "$t ${min:-$t}" | awk '{ print ($1 < $2) ? $1 : $2 }')
+        i=$((i + 1))
+    done
+    echo "$min"
+)
@@ -0,0 +1,76 @@
+#!/bin/sh
+# Constant and copy propagation: compiles loops driven by variables set
+# once to literals (sizes, scale factors, flags) and by copies of them
+# with and without parsercodegen --constprop (both with --dce, which
+# drops the branches constant flags decide), checks that both print the
+# same, and reports code size, instructions executed (vm --count) and the
+# fastest wall time.
+#
+# Usage: bench/constprop.sh [runs]   (from the repository root, default 3)
+
+set -e
+ROOT=$(cd "$(dirname "$0")/.." && pwd)
+WORK=$(mktemp -d)
+trap 'rm -rf "$WORK"' EXIT
+. "$ROOT/bench/common.sh"
+RUNS=${1:-3}
+
+gcc -O2 -std=c11 -o "$WORK/lex" "$ROOT/lex.c"
+gcc -O2 -std=c11 -o "$WORK/parsercodegen" "$ROOT/parsercodegen.c"
+gcc -O2 -std=c11 -pthread -o "$WORK/vm" "$ROOT/vm.c"
+cd "$WORK"
+
+# program <name> <setup> <statement>: setup, then a 2000 x 1000 loop
+# around statement into <name>.txt
+program() {
+    cat > "$1.txt" << EOF
+var i, j, n, m, k, scale, bias, debug, limit, s;
+begin
+  $2;
+  s := 0; i := 0;
+  while i < n do
+  begin
+    j := 0;
+    while j < m do
+    begin
+      $3;
+      j := j + 1
+    end;
+    i := i + 1
+  end;
+  write s
+end.
+EOF
+}
+
+program scaled "n := 2000; m := 1000; scale := 4; bias := 3 * scale + 1; k := scale" \
+    "s := s + j * k + bias - scale / 2"
+program flags "n := 2000; m := 1000; debug := 0; limit := 50 * 20; k := limit" \
+    "if debug = 1 then write j fi; if j < k then s := s + 1 fi; if debug > 0 then s := s - 1 fi"
+program copies "n := 2000; m := 1000; scale := 7; k := scale; bias := k; limit := bias * 2" \
+    "s := s + (j + k) * bias - limit"
+
+printf "%-8s %6s %11s %13s %13s %10s %11s %8s\n" "program" "code" "--constprop" "instructions" "--constprop" "plain" "--constprop" "speedup"
+for name in scaled flags copies; do
+    ./lex "$name.txt" > /dev/null
+    ./parsercodegen --dce > /dev/null
+    mv elf.txt "$name.elf"
+    ./parsercodegen --constprop --dce > /dev/null
+    mv elf.txt "$name.constprop.elf"
+
+    ./vm "$name.elf" > plain.out
+    ./vm "$name.constprop.elf" > constprop.out
+    if ! cmp -s plain.out constprop.out; then
+        echo "Error: --constprop output differs for $name" >&2
+        exit 1
+    fi
+
+    plain_count=$(./vm --count "$name.elf" 2>&1 > /dev/null | awk '{ print $3 }')
+    constprop_count=$(./vm --count "$name.constprop.elf" 2>&1 > /dev/null | awk '{ print $3 }')
+    plain_time=$(wall "./vm $name.elf")
+    constprop_time=$(wall "./vm $name.constprop.elf")
+    printf "%-8s %6s %11s %13s %13s %10s %11s %8s\n" "$name" \
+        "$(wc -l < "$name.elf")" "$(wc -l < "$name.constprop.elf")" \
+        "$plain_count" "$constprop_count" "$plain_time" "$constprop_time" \
+        "$(echo "$plain_time $constprop_time" | awk '{ printf "%.2fx", $1 / $2 }')"
+done
@@ -0,0 +1,86 @@
+#!/bin/sh
+# Deep-nesting stress run: generates programs nested DEPTH levels deep in
+# parentheses, begin, if and while, compiles each with the recursive and
+# the --iterative parser, checks that both produce the same listing and
+# elf.txt whenever the recursive one survives, and runs the result on vm.
+#
+# Usage: bench/deep.sh [depth]   (from the repository root, default 100000)
+
+set -e
+ROOT=$(cd "$(dirname "$0")/.." && pwd)
+WORK=$(mktemp -d)
+trap 'rm -rf "$WORK"' EXIT
+DEPTH=${1:-100000}
+
+# tables sized for roughly ten tokens and five instructions per level
+LIMITS="-DMAX_TOKENS=$((DEPTH * 10 + 100)) -DMAX_SOURCE_SIZE=$((DEPTH * 64 + 4096)) -DMAX_CODE_LENGTH=$((DEPTH * 5 + 100))"
+
+gcc -O2 -std=c11 $LIMITS -o "$WORK/lex" "$ROOT/lex.c"
+gcc -O2 -std=c11 $LIMITS -o "$WORK/parsercodegen" "$ROOT/parsercodegen.c"
+gcc -O2 -std=c11 -o "$WORK/vm" "$ROOT/vm.c"
+
+# generate <shape>: program nested DEPTH levels deep
+generate() {
+    awk -v shape="$1" -v depth="$DEPTH" 'BEGIN {
+        print "var x;"
+        print "begin"
+        print "x := 0;"
+        if (shape == "parens") {
+            # left-nested so the VM operand stack stays shallow
+            printf "x := "
+            for (i = 0; i < depth; i++) printf "("
+            printf "1"
+            for (i = 0; i < depth; i++) printf " + x)\n"
+            print ";"
+        } else {
+            for (i = 0; i < depth; i++) {
+                if (shape == "begin") print "begin"
+                else if (shape == "if") print "if x = 0 then"
+                else print "while x < 1 do"
+            }
+            print "x := x + 1"
+            for (i = 0; i < depth; i++) {
+                if (shape == "begin") print "end"
+                else if (shape == "if") print "fi"
+            }
+            print ";"
+        }
+        print "write x"
+        print "end."
+    }'
+}
+
+# compile <flags>: prints "<status> <seconds>"; listing in $WORK/listing
+compile() {
+    start=$(date +%s.%N)
+    status=0
+    (cd "$WORK" && ./parsercodegen $1 > listing 2> /dev/null) || status=$?
+    end=$(date +%s.%N)
+    echo "$status $(awk "BEGIN { print $end - $start }")"
+}
+
+printf '%-8s %8s %12s %10s %12s %10s %8s %6s\n' shape depth recursive rec_s iterative iter_s same output
+for shape in parens begin if while; do
+    generate "$shape" > "$WORK/deep.txt"
+    (cd "$WORK" && ./lex deep.txt > /dev/null)
+
+    set -- $(compile "" 2> /dev/null)
+    rec_status=$1 rec_time=$2
+    [ "$rec_status" = 0 ] && cp "$WORK/listing" "$WORK/rec.listing" && cp "$WORK/elf.txt" "$WORK/rec.elf"
+
+    set -- $(compile "--iterative" 2> /dev/null)
+    iter_status=$1 iter_time=$2
+
+    same=-
+    if [ "$rec_status" = 0 ] && [ "$iter_status" = 0 ]; then
+        same=no
+        cmp -s "$WORK/listing" "$WORK/rec.listing" && cmp -s "$WORK/elf.txt" "$WORK/rec.elf" && same=yes
+    fi
+
+    output=-
+    [ "$iter_status" = 0 ] && output=$("$WORK/vm" "$WORK/elf.txt" 2> /dev/null || echo fail)
+
+    label() { if [ "$1" = 0 ]; then echo ok; elif [ "$1" -gt 128 ]; then echo "signal $(($1 - 128))"; else echo "exit $1"; fi; }
+    printf '%-8s %8s %12s %10.3f %12s %10.3f %8s %6s\n' "$shape" "$DEPTH" "$(label "$rec_status")" "$rec_time" \
+        "$(label "$iter_status")" "$iter_time" "$same" "$output"
+done
@@ -0,0 +1,56 @@
+#!/bin/sh
+# Dead store elimination: compiles generated programs (bench/plgen.c, a few
+# seeds per size) with and without parsercodegen --dse, checks that both
+# print the same, and reports code size, frame size (the INC operand) and
+# instructions executed (vm --count) for each.
+#
+# Usage: bench/dse.sh [seeds]   (from the repository root, default 5)
+
+set -e
+ROOT=$(cd "$(dirname "$0")/.." && pwd)
+WORK=$(mktemp -d)
+trap 'rm -rf "$WORK"' EXIT
+. "$ROOT/bench/common.sh"
+SEEDS=${1:-5}
+
+gcc -O2 -std=c11 $LIMITS -o "$WORK/lex" "$ROOT/lex.c"
+gcc -O2 -std=c11 $LIMITS -o "$WORK/parsercodegen" "$ROOT/parsercodegen.c"
+gcc -O2 -std=c11 -pthread -o "$WORK/vm" "$ROOT/vm.c"
+gcc -O2 -std=c11 -o "$WORK/plgen" "$ROOT/bench/plgen.c"
+cd "$WORK"
+
+# frame <elf>: operand of the INC (second instruction)
+frame() {
+    sed -n '2p' "$1" | awk '{ print $3 }'
+}
+
+# count <elf>: instructions executed
+count() {
+    ./vm --count "$1" 2>&1 > /dev/null | awk '{ print $3 }'
+}
+
+printf "%-10s %9s %9s %7s %7s %12s %12s\n" "program" "code" "--dse" "frame" "--dse" "executed" "--dse"
+for size in 2K 32K 256K; do
+    seed=1
+    while [ $seed -le "$SEEDS" ]; do
+        ./plgen --size "$size" --decls 40 --seed "$seed" > program.txt
+        ./lex program.txt > /dev/null
+        ./parsercodegen > /dev/null
+        mv elf.txt plain.elf
+        ./parsercodegen --dse > /dev/null
+        mv elf.txt dse.elf
+
+        ./vm plain.elf > plain.out
+        ./vm dse.elf > dse.out
+        if ! cmp -s plain.out dse.out; then
+            echo "Error: --dse output differs for --size $size --seed $seed" >&2
+            exit 1
+        fi
+
+        printf "%-10s %9s %9s %7s %7s %12s %12s\n" "$size/$seed" \
+            "$(wc -l < plain.elf)" "$(wc -l < dse.elf)" \
+            "$(frame plain.elf)" "$(frame dse.elf)" \
+            "$(count plain.elf)" "$(count dse.elf)"
+        seed=$((seed + 1))
+    done
+done
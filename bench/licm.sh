@@ -0,0 +1,50 @@
+#!/bin/sh
+# Loop-invariant code motion benchmark: runs each loop-heavy program in
+# bench/ with and without --licm and compares dynamic instruction counts
+# and wall time on the PM/0 VM.
+#
+# Usage: bench/licm.sh   (from the repository root)
+
+set -e
+ROOT=$(cd "$(dirname "$0")/.." && pwd)
+WORK=$(mktemp -d)
+trap 'rm -rf "$WORK"' EXIT
+
+gcc -O2 -std=c11 -o "$WORK/lex" "$ROOT/lex.c"
+gcc -O2 -std=c11 -o "$WORK/parsercodegen" "$ROOT/parsercodegen.c"
+gcc -O2 -std=c11 -o "$WORK/vm" "$ROOT/vm.c"
+
+# program input (one integer per line)
+input_for() {
+    case "$1" in
+    licm_nested) printf '100\n30\n' ;;
+    licm_bound) printf '2000\n7\n' ;;
+    licm_poly) printf '1\n200000\n9\n' ;;
+    esac
+}
+
+# run <name> <flags>: prints "<instructions> <seconds> <output>"
+run() {
+    (cd "$WORK" && ./parsercodegen $2 > /dev/null)
+    start=$(date +%s.%N)
+    out=$(input_for "$1" | "$WORK/vm" --count "$WORK/elf.txt" 2> "$WORK/count.txt" | tr '\n' ',')
+    end=$(date +%s.%N)
+    steps=$(sed -n 's/^instructions executed: //p' "$WORK/count.txt")
+    echo "$steps $(awk "BEGIN { print $end - $start }") $out"
+}
+
+printf '%-14s %14s %14s %9s %9s %8s\n' program base_instrs licm_instrs base_s licm_s saved
+for src in "$ROOT"/bench/licm_*.txt; do
+    name=$(basename "$src" .txt)
+    (cd "$WORK" && ./lex "$src" > /dev/null)
+    set -- $(run "$name" "")
+    base_steps=$1 base_time=$2 base_out=$3
+    set -- $(run "$name" "--licm")
+    licm_steps=$1 licm_time=$2 licm_out=$3
+    if [ "$base_out" != "$licm_out" ]; then
+        echo "$name: output differs ($base_out vs $licm_out)" >&2
+        exit 1
+    fi
+    printf '%-14s %14s %14s %9.3f %9.3f %7.1f%%\n' "$name" "$base_steps" "$licm_steps" \
+        "$base_time" "$licm_time" "$(awk "BEGIN { print 100 * ($base_steps - $licm_steps) / $base_steps }")"
+done
@@ -0,0 +1,41 @@
+#!/bin/sh
+# Pipeline comparison: times "lex file && parsercodegen" (two processes
+# through tokens.txt) against the combined binary's --pipeline mode (scanner
+# and parser on two threads through pipeline.h's ring), checking that both
+# leave the same listing and elf.txt.
+#
+# Usage: bench/pipeline.sh [sizes] [runs]   (from the repository root,
+#        default "1M 4M 16M" and 3)
+
+set -e
+ROOT=$(cd "$(dirname "$0")/.." && pwd)
+WORK=$(mktemp -d)
+trap 'rm -rf "$WORK"' EXIT
+. "$ROOT/bench/common.sh"
+SIZES=${1:-"1M 4M 16M"}
+RUNS=${2:-3}
+
+gcc -O2 -std=c11 $LIMITS -o "$WORK/lex" "$ROOT/lex.c"
+gcc -O2 -std=c11 $LIMITS -o "$WORK/parsercodegen" "$ROOT/parsercodegen.c"
+gcc -O2 -std=c11 $LIMITS -pthread -DPL0_PIPELINE -o "$WORK/pl0c" "$ROOT/parsercodegen.c" "$ROOT/lex.c"
+gcc -O2 -std=c11 -o "$WORK/plgen" "$ROOT/bench/plgen.c"
+
+cd "$WORK"
+printf "%-8s %12s %12s %9s\n" "size" "sequential" "pipeline" "speedup"
+for size in $SIZES; do
+    ./plgen --size "$size" > program.txt
+
+    ./lex program.txt > /dev/null
+    ./parsercodegen > sequential.out
+    cp elf.txt sequential.elf
+    ./pl0c --pipeline program.txt > pipeline.out
+    if ! cmp -s sequential.out pipeline.out || ! cmp -s sequential.elf elf.txt; then
+        echo "Error: --pipeline output differs at size $size" >&2
+        exit 1
+    fi
+
+    seq_time=$(wall "./lex program.txt && ./parsercodegen")
+    pipe_time=$(wall "./pl0c --pipeline program.txt")
+    printf "%-8s %12s %12s %9s\n" "$size" "$seq_time" "$pipe_time" \
+        "$(echo "$seq_time $pipe_time" | awk '{ printf "%.2fx", $1 / $2 }')"
+done
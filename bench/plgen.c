@@ -0,0 +1,353 @@
+/*
+Assignment:
+HW3 - Synthetic PL/0 program generator for the benchmark suite
+Author(s): Jacob Smith, Jakson Zapata
+Language: C (only)
+
+To Compile:
+gcc -O2 -std=c11 -o plgen bench/plgen.c
+
+To Execute (on Eustis):
+./plgen [options] > program.txt
+
+where options are:
+--size <bytes>      approximate program size, K/M suffixes allowed (default 1K)
+--decls <n>         number of const and var declarations (default 20)
+--depth <n>         maximum nesting of begin/if/while (default 3)
+--expr <n>          binary operators per expression (default 4)
+--comments <pct>    percent of statements preceded by a comment (default 0)
+--ident-len <n>     identifier length, 2 to MAX_IDENT_LEN (default 6)
+--seed <n>          random seed (default 1)
+
+Notes:
+- Output follows the grammar parsercodegen.c accepts. Every while loop
+  counts a dedicated counter (one per nesting level) up to a small bound,
+  every divisor is a nonzero literal and nothing is read, so generated
+  programs also run to completion on vm.c
+- lex.c emits tokens for comment delimiters and parsercodegen rejects
+  them, so --comments > 0 is only useful for lexer-only measurements
+- The same options and seed always produce the same program
+
+Class: COP3402 - System Software - Fall 2025
+Instructor: Dr. Jie Lin
+Due Date: Friday, October 31, 2025 at 11:59 PM ET
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define MAX_IDENT_LEN 11
+#define MAX_NUMBER 99999
+
+// Generator settings
+long target_size = 1024;
+int num_decls = 20;
+int max_depth = 3;
+int expr_ops = 4;
+int comment_pct = 0;
+int ident_len = 6;
+unsigned long long rng_state = 1;
+
+// Output state
+long bytes_written = 0;
+int num_consts = 0;
+int num_vars = 0;
+
+// Function prototypes
+long parse_size(const char *text);
+unsigned next_random(unsigned bound);
+void put(const char *text);
+void put_name(char prefix, int index);
+void put_number(int value);
+void indent(int depth);
+void comment(int depth);
+void operand(int ops_left);
+void expression(int ops);
+void condition();
+void statement(int depth);
+
+// Main function
+int main(int argc, char *argv[])
+{
+    for (int i = 1; i < argc; i++)
+    {
+        const char *value = i + 1 < argc ? argv[i + 1] : NULL;
+        if (value == NULL)
+        {
+            fprintf(stderr, "Error: %s needs a value\n", argv[i]);
+            return 1;
+        }
+
+        if (strcmp(argv[i], "--size") == 0)
+            target_size = parse_size(value);
+        else if (strcmp(argv[i], "--decls") == 0)
+            num_decls = atoi(value);
+        else if (strcmp(argv[i], "--depth") == 0)
+            max_depth = atoi(value);
+        else if (strcmp(argv[i], "--expr") == 0)
+            expr_ops = atoi(value);
+        else if (strcmp(argv[i], "--comments") == 0)
+            comment_pct = atoi(value);
+        else if (strcmp(argv[i], "--ident-len") == 0)
+            ident_len = atoi(value);
+        else if (strcmp(argv[i], "--seed") == 0)
+            rng_state = strtoull(value, NULL, 10) * 2654435761ULL + 1;
+        else
+        {
+            fprintf(stderr, "Usage: ./plgen [--size <bytes>] [--decls <n>] [--depth <n>] [--expr <n>]\n"
+                            "               [--comments <pct>] [--ident-len <n>] [--seed <n>]\n");
+            return 1;
+        }
+        i++;
+    }
+
+    // Names are one letter plus a zero-padded index
+    long max_names = 1;
+    for (int i = 1; i < ident_len && max_names < 1000000000L; i++)
+        max_names *= 10;
+    if (ident_len < 2 || ident_len > MAX_IDENT_LEN || num_decls < 1 || num_decls > max_names ||
+        max_depth < 0 || max_depth >= max_names || expr_ops < 0 || target_size <= 0)
+    {
+        fprintf(stderr, "Error: option out of range\n");
+        return 1;
+    }
+
+    num_consts = num_decls / 4;
+    num_vars = num_decls - num_consts;
+
+    if (num_consts > 0)
+    {
+        put("const ");
+        for (int i = 0; i < num_consts; i++)
+        {
+            if (i > 0)
+                put(", ");
+            put_name('k', i);
+            put(" = ");
+            put_number((int)next_random(1000));
+        }
+        put(";\n");
+    }
+
+    // Loop counters (w) are never assigned outside their own loop
+    put("var ");
+    for (int i = 0; i < num_vars; i++)
+    {
+        if (i > 0)
+            put(", ");
+        put_name('v', i);
+    }
+    for (int d = 0; d < max_depth; d++)
+    {
+        put(", ");
+        put_name('w', d);
+    }
+    put(";\n");
+
+    put("begin\n");
+    int first = 1;
+    while (first || bytes_written + 8 < target_size)
+    {
+        if (!first)
+            put(";\n");
+        indent(0);
+        statement(0);
+        first = 0;
+    }
+    put("\nend.\n");
+
+    return 0;
+}
+
+// "64K" -> 65536 style sizes
+long parse_size(const char *text)
+{
+    char *end;
+    long value = strtol(text, &end, 10);
+    if (*end == 'K' || *end == 'k')
+        value *= 1024;
+    else if (*end == 'M' || *end == 'm')
+        value *= 1024 * 1024;
+    return value;
+}
+
+// xorshift64*, so programs are reproducible across platforms
+unsigned next_random(unsigned bound)
+{
+    rng_state ^= rng_state >> 12;
+    rng_state ^= rng_state << 25;
+    rng_state ^= rng_state >> 27;
+    return (unsigned)((rng_state * 2685821657736338717ULL) >> 33) % bound;
+}
+
+void put(const char *text)
+{
+    size_t len = strlen(text);
+    fwrite(text, 1, len, stdout);
+    bytes_written += (long)len;
+}
+
+void put_name(char prefix, int index)
+{
+    char name[MAX_IDENT_LEN + 1];
+    snprintf(name, sizeof name, "%c%0*d", prefix, ident_len - 1, index);
+    put(name);
+}
+
+void put_number(int value)
+{
+    char digits[16];
+    snprintf(digits, sizeof digits, "%d", value);
+    put(digits);
+}
+
+void indent(int depth)
+{
+    for (int i = 0; i <= depth; i++)
+        put("  ");
+}
+
+// Comments go between statements; their delimiters become lex tokens
+void comment(int depth)
+{
+    static const char *words[] = {"update", "the", "running", "total", "check", "bound", "loop", "value"};
+    put("/* ");
+    int n = 1 + (int)next_random(6);
+    for (int i = 0; i < n; i++)
+    {
+        put(words[next_random(8)]);
+        put(" ");
+    }
+    put("*/\n");
+    indent(depth);
+}
+
+// A variable, constant or literal; a parenthesized sub-expression when
+// there is operator budget left
+void operand(int ops_left)
+{
+    if (ops_left >= 2 && next_random(5) == 0)
+    {
+        put("(");
+        expression(1 + (int)next_random((unsigned)ops_left - 1));
+        put(")");
+        return;
+    }
+
+    unsigned pick = next_random(10);
+    if (pick < 6)
+        put_name('v', (int)next_random((unsigned)num_vars));
+    else if (pick < 8 && num_consts > 0)
+        put_name('k', (int)next_random((unsigned)num_consts));
+    else
+        put_number((int)next_random(MAX_NUMBER + 1));
+}
+
+void expression(int ops)
+{
+    operand(ops);
+    for (int i = 0; i < ops; i++)
+    {
+        unsigned pick = next_random(4);
+        if (pick == 3)
+        {
+            // Division only by a nonzero literal so runs never trap
+            put(" / ");
+            put_number(1 + (int)next_random(9));
+            continue;
+        }
+        put(pick == 0 ? " + " : pick == 1 ? " - " : " * ");
+        operand(ops - i);
+    }
+}
+
+void condition()
+{
+    static const char *relops[] = {" = ", " <> ", " < ", " <= ", " > ", " >= "};
+    if (next_random(6) == 0)
+    {
+        put("even ");
+        expression(expr_ops / 2);
+        return;
+    }
+    expression(expr_ops / 2);
+    put(relops[next_random(6)]);
+    expression(expr_ops / 2);
+}
+
+void statement(int depth)
+{
+    if (comment_pct > 0 && (int)next_random(100) < comment_pct)
+        comment(depth);
+
+    unsigned pick = depth < max_depth ? next_random(20) : next_random(12);
+
+    if (pick < 10)
+    {
+        put_name('v', (int)next_random((unsigned)num_vars));
+        put(" := ");
+        expression(expr_ops);
+    }
+    else if (pick < 12)
+    {
+        put("write ");
+        expression(expr_ops);
+    }
+    else if (pick < 15)
+    {
+        put("begin\n");
+        int n = 1 + (int)next_random(4);
+        for (int i = 0; i < n; i++)
+        {
+            indent(depth + 1);
+            statement(depth + 1);
+            put(i + 1 < n ? ";\n" : "\n");
+        }
+        indent(depth);
+        put("end");
+    }
+    else if (pick < 18)
+    {
+        put("if ");
+        condition();
+        put(" then\n");
+        indent(depth + 1);
+        statement(depth + 1);
+        put("\n");
+        indent(depth);
+        put("fi");
+    }
+    else
+    {
+        // begin w := 0; while w < bound do begin ...; w := w + 1 end end
+        put("begin\n");
+        indent(depth + 1);
+        put_name('w', depth);
+        put(" := 0;\n");
+        indent(depth + 1);
+        put("while ");
+        put_name('w', depth);
+        put(" < ");
+        put_number(1 + (int)next_random(4));
+        put(" do\n");
+        indent(depth + 1);
+        put("begin\n");
+        int n = 1 + (int)next_random(3);
+        for (int i = 0; i < n; i++)
+        {
+            indent(depth + 2);
+            statement(depth + 1);
+            put(";\n");
+        }
+        indent(depth + 2);
+        put_name('w', depth);
+        put(" := ");
+        put_name('w', depth);
+        put(" + 1\n");
+        indent(depth + 1);
+        put("end\n");
+        indent(depth);
+        put("end");
+    }
+}
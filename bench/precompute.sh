@@ -0,0 +1,90 @@
+#!/bin/sh
+# Compile-time evaluation: compiles input-free programs (bench/plgen.c,
+# which never reads, plus a prime sieve and a loop longer than the step
+# budget) with and without parsercodegen --precompute, checks that both
+# print the same, and reports code size, instructions executed (vm
+# --count), the fastest compile + run wall time of each and what the
+# listing says --precompute did.
+#
+# Usage: bench/precompute.sh [runs]   (from the repository root, default 3)
+
+set -e
+ROOT=$(cd "$(dirname "$0")/.." && pwd)
+WORK=$(mktemp -d)
+trap 'rm -rf "$WORK"' EXIT
+. "$ROOT/bench/common.sh"
+RUNS=${1:-3}
+
+gcc -O2 -std=c11 $LIMITS -o "$WORK/lex" "$ROOT/lex.c"
+gcc -O2 -std=c11 $LIMITS -o "$WORK/parsercodegen" "$ROOT/parsercodegen.c"
+gcc -O2 -std=c11 -pthread -o "$WORK/vm" "$ROOT/vm.c"
+gcc -O2 -std=c11 -o "$WORK/plgen" "$ROOT/bench/plgen.c"
+cd "$WORK"
+
+./plgen --size 2K --seed 1 > gen2k.txt
+./plgen --size 32K --seed 1 > gen32k.txt
+./plgen --size 256K --seed 1 > gen256k.txt
+
+# Primes below 2000 by trial division: about 1.5M instructions
+cat > primes.txt << 'EOF'
+var n, d, prime, count;
+begin
+  n := 2; count := 0;
+  while n < 2000 do
+  begin
+    prime := 1; d := 2;
+    while d * d <= n do
+    begin
+      if (n / d) * d = n then prime := 0 fi;
+      d := d + 1
+    end;
+    if prime = 1 then count := count + 1 fi;
+    n := n + 1
+  end;
+  write count
+end.
+EOF
+
+# 3000 x 1000 iterations: past the default budget, so the code stays
+cat > long.txt << 'EOF'
+var i, j, s;
+begin
+  i := 0; s := 0;
+  while i < 3000 do
+  begin
+    j := 0;
+    while j < 1000 do
+    begin
+      s := s + i - j;
+      j := j + 1
+    end;
+    i := i + 1
+  end;
+  write s
+end.
+EOF
+
+printf "%-8s %7s %12s %11s %12s %10s %12s  %s\n" "program" "code" "--precompute" "executed" "--precompute" "plain" "--precompute" "result"
+for name in gen2k gen32k gen256k primes long; do
+    ./lex "$name.txt" > /dev/null
+    ./parsercodegen > /dev/null
+    mv elf.txt "$name.elf"
+    ./parsercodegen --precompute > listing.txt
+    mv elf.txt "$name.precompute.elf"
+
+    ./vm "$name.elf" > plain.out
+    ./vm "$name.precompute.elf" > precompute.out
+    if ! cmp -s plain.out precompute.out; then
+        echo "Error: --precompute output differs for $name" >&2
+        exit 1
+    fi
+
+    plain_time=$(wall "./parsercodegen && ./vm elf.txt")
+    precompute_time=$(wall "./parsercodegen --precompute && ./vm elf.txt")
+    printf "%-8s %7s %12s %11s %12s %10s %12s  %s\n" "$name" \
+        "$(wc -l < "$name.elf")" "$(wc -l < "$name.precompute.elf")" \
+        "$(./vm --count "$name.elf" 2>&1 > /dev/null | awk '{ print $3 }')" \
+        "$(./vm --count "$name.precompute.elf" 2>&1 > /dev/null | awk '{ print $3 }')" \
+        "$plain_time" "$precompute_time" \
+        "$(sed -n 's/^Compile-time evaluation: //p' listing.txt | sed 's/ instructions run)/ run)/')"
+done
@@ -0,0 +1,28 @@
+#!/bin/sh
+# Build lex, parsercodegen and the benchmark tools with table sizes large
+# enough for generated programs, then run the harness.
+#
+# Usage: bench/run.sh [bench options]   (from the repository root)
+#   e.g. bench/run.sh --sizes 1K,64K,1M --runs 3 -- --depth 4 --expr 6
+#        bench/run.sh --sizes 64K --perf   (hardware counters, see perfcount.h)
+#
+# Results are JSON lines on stdout; redirect them to a file to track
+# regressions across commits.
+
+set -e
+ROOT=$(cd "$(dirname "$0")/.." && pwd)
+. "$ROOT/bench/common.sh"
+WORK=${BENCH_WORK:-$(mktemp -d)}
+BIN="$WORK/bin"
+mkdir -p "$BIN"
+
+gcc -O2 -std=c11 $LIMITS -o "$BIN/lex" "$ROOT/lex.c"
+gcc -O2 -std=c11 $LIMITS -o "$BIN/parsercodegen" "$ROOT/parsercodegen.c"
+gcc -O2 -std=c11 -o "$BIN/plgen" "$ROOT/bench/plgen.c"
+gcc -O2 -std=c11 -o "$BIN/bench" "$ROOT/bench/bench.c"
+
+"$BIN/bench" --bin "$BIN" --work "$WORK" --max-tokens "$MAX_TOKENS" "$@"
+
+if [ -z "$BENCH_WORK" ]; then
+    rm -rf "$WORK"
+fi
@@ -0,0 +1,54 @@
+#!/bin/sh
+# Scanner comparison: generates scantab.h with scangen, builds lex with
+# -DLEX_TABLE_SCANNER, and times the hand-written scanner against --table
+# on a mixed corpus (comments, short and maximum-length identifiers, long
+# and short expressions). Checks that both produce the same tokens.txt and
+# tokens.lines, then prints the best scan phase time of each (lex --stats)
+# and the wall time of --stream runs, where only the scanner and the token
+# file writer are left.
+#
+# Usage: bench/scan.sh [size] [runs]   (from the repository root, default 4M 5)
+
+set -e
+ROOT=$(cd "$(dirname "$0")/.." && pwd)
+WORK=$(mktemp -d)
+trap 'rm -rf "$WORK"' EXIT
+. "$ROOT/bench/common.sh"
+SIZE=${1:-4M}
+RUNS=${2:-5}
+
+gcc -O2 -std=c11 -o "$WORK/scangen" "$ROOT/scangen.c"
+"$WORK/scangen" > "$WORK/scantab.h"
+gcc -O2 -std=c11 $LIMITS -I"$WORK" -DLEX_TABLE_SCANNER -o "$WORK/lex" "$ROOT/lex.c"
+gcc -O2 -std=c11 -o "$WORK/plgen" "$ROOT/bench/plgen.c"
+
+# best <command...>: fastest "scan" phase over RUNS runs of lex --stats=json
+best() {
+    i=0
+    min=
+    while [ $i -lt "$RUNS" ]; do
+        t=$("$@" --stats=json 2>&1 > /dev/null | sed -n 's/.*"scan": \([0-9.]*\).*/\1/p')
+        min=$(echo "$t ${min:-$t}" | awk '{ print ($1 < $2) ? $1 : $2 }')
+        i=$((i + 1))
+    done
+    echo "$min"
+}
+
+cd "$WORK"
+printf "%-34s %12s %12s %12s %12s\n" "corpus" "scan hand" "scan table" "stream hand" "stream table"
+for corpus in "--comments 30 --ident-len 11" "--comments 0 --ident-len 3" "--expr 8 --ident-len 6" "--depth 6 --expr 2 --comments 10"; do
+    ./plgen --size "$SIZE" $corpus > corpus.txt
+
+    ./lex -g corpus.txt > hand.out
+    cp tokens.txt hand.tokens
+    cp tokens.lines hand.lines
+    ./lex --table -g corpus.txt > table.out
+    if ! cmp -s hand.out table.out || ! cmp -s hand.tokens tokens.txt || ! cmp -s hand.lines tokens.lines; then
+        echo "Error: scanners disagree on $corpus" >&2
+        exit 1
+    fi
+
+    printf "%-34s %12s %12s %12s %12s\n" "$corpus" \
+        "$(best ./lex corpus.txt)" "$(best ./lex --table corpus.txt)" \
+        "$(wall "./lex --stream corpus.txt")" "$(wall "./lex --stream --table corpus.txt")"
+done
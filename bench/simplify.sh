@@ -0,0 +1,68 @@
+#!/bin/sh
+# Algebraic simplification: compiles loops whose expressions multiply and
+# divide by powers of two and carry identities (x * 1, x + 0, x - x) with
+# and without parsercodegen --simplify, checks that both print the same,
+# and reports instructions executed (vm --count) and the fastest wall time.
+#
+# Usage: bench/simplify.sh [runs]   (from the repository root, default 3)
+
+set -e
+ROOT=$(cd "$(dirname "$0")/.." && pwd)
+WORK=$(mktemp -d)
+trap 'rm -rf "$WORK"' EXIT
+. "$ROOT/bench/common.sh"
+RUNS=${1:-3}
+
+gcc -O2 -std=c11 -o "$WORK/lex" "$ROOT/lex.c"
+gcc -O2 -std=c11 -o "$WORK/parsercodegen" "$ROOT/parsercodegen.c"
+gcc -O2 -std=c11 -pthread -o "$WORK/vm" "$ROOT/vm.c"
+cd "$WORK"
+
+# program <name> <statement>: 2000 x 1000 loop around statement into <name>.txt
+program() {
+    cat > "$1.txt" << EOF
+var i, j, x, s;
+begin
+  i := 0; x := 3; s := 0;
+  while i < 2000 do
+  begin
+    j := 0;
+    while j < 1000 do
+    begin
+      $2;
+      j := j + 1
+    end;
+    i := i + 1
+  end;
+  write s; write x
+end.
+EOF
+}
+
+program shifts "s := s + (i - j) * 8 / 4 - j / 16"
+program identities "s := (s + 0) * 1 + (i - i) * j + (j - 500) / 1"
+program mixed "x := (x * 1 + j * 4 - (i / 2) * 0) / 8 + (i - 1000) / 2"
+
+printf "%-11s %13s %13s %10s %10s %8s\n" "program" "instructions" "--simplify" "plain" "--simplify" "speedup"
+for name in shifts identities mixed; do
+    ./lex "$name.txt" > /dev/null
+    ./parsercodegen > /dev/null
+    mv elf.txt "$name.elf"
+    ./parsercodegen --simplify > /dev/null
+    mv elf.txt "$name.simplify.elf"
+
+    ./vm "$name.elf" > plain.out
+    ./vm "$name.simplify.elf" > simplify.out
+    if ! cmp -s plain.out simplify.out; then
+        echo "Error: --simplify output differs for $name" >&2
+        exit 1
+    fi
+
+    plain_count=$(./vm --count "$name.elf" 2>&1 > /dev/null | awk '{ print $3 }')
+    simplify_count=$(./vm --count "$name.simplify.elf" 2>&1 > /dev/null | awk '{ print $3 }')
+    plain_time=$(wall "./vm $name.elf")
+    simplify_time=$(wall "./vm $name.simplify.elf")
+    printf "%-11s %13s %13s %10s %10s %8s\n" "$name" "$plain_count" "$simplify_count" \
+        "$plain_time" "$simplify_time" \
+        "$(echo "$plain_time $simplify_time" | awk '{ printf "%.2fx", $1 / $2 }')"
+done
@@ -0,0 +1,71 @@
+#!/bin/sh
+# Top-of-stack caching: runs expression-heavy loops on the plain
+# interpreter and on vm --tos, checking that both print the same, and
+# reports the fastest wall time of each next to the stack loads and stores
+# executed (counted by a second vm built with -DVM_STACK_TRAFFIC).
+#
+# Usage: bench/tos.sh [runs]   (from the repository root, default 3)
+
+set -e
+ROOT=$(cd "$(dirname "$0")/.." && pwd)
+WORK=$(mktemp -d)
+trap 'rm -rf "$WORK"' EXIT
+. "$ROOT/bench/common.sh"
+RUNS=${1:-3}
+
+gcc -O2 -std=c11 -o "$WORK/lex" "$ROOT/lex.c"
+gcc -O2 -std=c11 -o "$WORK/parsercodegen" "$ROOT/parsercodegen.c"
+gcc -O2 -std=c11 -pthread -o "$WORK/vm" "$ROOT/vm.c"
+gcc -O2 -std=c11 -pthread -DVM_STACK_TRAFFIC -o "$WORK/vm_traffic" "$ROOT/vm.c"
+cd "$WORK"
+
+# compile <name> <statement>: 2000 x 1000 loop around statement into <name>.elf
+compile() {
+    cat > "$1.txt" << EOF
+var i, j, x, y, s;
+begin
+  i := 0; x := 1; y := 2; s := 0;
+  while i < 2000 do
+  begin
+    j := 0;
+    while j < 1000 do
+    begin
+      $2;
+      j := j + 1
+    end;
+    i := i + 1
+  end;
+  write s; write x; write y
+end.
+EOF
+    ./lex "$1.txt" > /dev/null
+    ./parsercodegen > /dev/null
+    mv elf.txt "$1.elf"
+}
+
+# traffic <flags> <elf>: "loads+stores" from the counting build
+traffic() {
+    ./vm_traffic --count $1 "$2" 2>&1 > /dev/null |
+        sed -n 's/stack reads: \([0-9]*\), stack writes: \([0-9]*\)/\1 \2/p' |
+        awk '{ printf "%.1fM", ($1 + $2) / 1e6 }'
+}
+
+compile sum "s := s + i * j - (i + j) / 3"
+compile poly "x := ((i * 3 + j) * (i - j) + x / 7 - (j * j + 5) * 2) / 5"
+compile compare "if (i + j) * 3 > x - 5 * (y + 1) then s := s + 1 fi; y := (y * 7 + j) / 3"
+compile even "if even (i * j + s) then s := s + (j - i) * 2 fi"
+
+printf "%-8s %10s %10s %8s %12s %12s\n" "program" "plain" "--tos" "speedup" "plain mem" "--tos mem"
+for name in sum poly compare even; do
+    ./vm "$name.elf" > plain.out
+    ./vm --tos "$name.elf" > tos.out
+    if ! cmp -s plain.out tos.out; then
+        echo "Error: --tos output differs for $name" >&2
+        exit 1
+    fi
+    plain_time=$(wall "./vm $name.elf")
+    tos_time=$(wall "./vm --tos $name.elf")
+    printf "%-8s %10s %10s %8s %12s %12s\n" "$name" "$plain_time" "$tos_time" \
+        "$(echo "$plain_time $tos_time" | awk '{ printf "%.2fx", $1 / $2 }')" \
+        "$(traffic "" "$name.elf")" "$(traffic --tos "$name.elf")"
+done
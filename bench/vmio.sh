@@ -0,0 +1,56 @@
+#!/bin/sh
+# VM I/O throughput: one program writes two million integers, another
+# reads two million and prints their sum. Each runs in text mode and with
+# --binary, next to a run with the I/O taken out (the same loop storing
+# the value instead of writing it), so the I/O share of the time is visible.
+#
+# Usage: bench/vmio.sh [runs]   (from the repository root, default 3)
+
+set -e
+ROOT=$(cd "$(dirname "$0")/.." && pwd)
+WORK=$(mktemp -d)
+trap 'rm -rf "$WORK"' EXIT
+. "$ROOT/bench/common.sh"
+RUNS=${1:-3}
+
+gcc -O2 -std=c11 -o "$WORK/lex" "$ROOT/lex.c"
+gcc -O2 -std=c11 -o "$WORK/parsercodegen" "$ROOT/parsercodegen.c"
+gcc -O2 -std=c11 -o "$WORK/vm" "$ROOT/vm.c"
+cd "$WORK"
+
+# compile <name> <statement>: 2000 x 1000 loop around statement into <name>.elf
+compile() {
+    cat > "$1.txt" << EOF
+var i, j, x, s;
+begin
+  i := 0; s := 0;
+  while i < 2000 do
+  begin
+    j := 0;
+    while j < 1000 do
+    begin
+      $2;
+      j := j + 1
+    end;
+    i := i + 1
+  end;
+  write s
+end.
+EOF
+    ./lex "$1.txt" > /dev/null
+    ./parsercodegen > /dev/null
+    mv elf.txt "$1.elf"
+}
+
+compile writes "write i * 1000 + j"
+compile reads "read x; s := s + x"
+compile none "x := i * 1000 + j"
+
+# Two million integers for the reader, as text and as binary
+awk 'BEGIN { for (i = 1; i <= 2000000; i++) print i }' > input.txt
+./vm --binary writes.elf | head -c 8000000 > input.bin
+
+printf "%-10s %10s %10s\n" "program" "text" "binary"
+printf "%-10s %10s %10s\n" "no I/O" "$(wall "./vm none.elf")" "-"
+printf "%-10s %10s %10s\n" "write" "$(wall "./vm writes.elf > /dev/null")" "$(wall "./vm --binary writes.elf > /dev/null")"
+printf "%-10s %10s %10s\n" "read" "$(wall "./vm reads.elf < input.txt")" "$(wall "./vm --binary reads.elf < input.bin")"
@@ -0,0 +1,310 @@
+/*
+Assignment:
+HW3 - Compilation cache shared by lex.c and parsercodegen.c (--cache)
+Author(s): Jacob Smith, Jakson Zapata
+Language: C (only)
+
+Notes:
+- An entry is keyed by an FNV-1a hash of the program's version, the table
+  sizes it was built with, the options that change its output and every
+  input file, and holds the listing and output files of one run:
+  "PL0CACHE2 <listing bytes> <n> <bytes of each artifact>\n" followed by
+  the listing and the n artifacts, in <dir>/<key>.pl0c
+- A hit replays the listing to stdout and rewrites the artifacts
+- Entries are written to a temporary file and renamed into place, so
+  concurrent runs never read a partial one
+- Past max_size bytes the least recently used entries are evicted; a hit
+  touches its entry, so its mtime is its last use
+- <dir>/<stats_name> counts hits, misses and evictions
+
+Class: COP3402 - System Software - Fall 2025
+Instructor: Dr. Jie Lin
+Due Date: Friday, October 31, 2025 at 11:59 PM ET
+*/
+
+#ifndef CACHE_H
+#define CACHE_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+#include <dirent.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <utime.h>
+
+#define CACHE_DEFAULT_SIZE (64L * 1024 * 1024)
+#define CACHE_MAX_ARTIFACTS 4
+
+typedef struct
+{
+    const char *dir;        // --cache <dir>, NULL when caching is off
+    long max_size;          // --cache-size
+    const char *version;    // changes whenever the program's output does
+    const char *stats_name; // hit/miss/eviction counters in dir
+    const char *options;    // options that change the output
+    long limits[2];         // table sizes the program was built with
+} cache_config;
+
+typedef struct
+{
+    char name[256];
+    long size;
+    time_t used;
+} cache_entry;
+
+// FNV-1a, used to content-address cache entries
+static inline uint64_t hash_bytes(uint64_t hash, const void *data, size_t len)
+{
+    const unsigned char *p = data;
+    for (size_t i = 0; i < len; i++)
+    {
+        hash ^= p[i];
+        hash *= 0x100000001b3ULL;
+    }
+    return hash;
+}
+
+// Copy len bytes (or everything when len < 0) between streams
+static inline void copy_bytes(FILE *from, FILE *to, long len)
+{
+    char chunk[8192];
+    while (len != 0)
+    {
+        size_t want = sizeof chunk;
+        if (len > 0 && (long)want > len)
+            want = (size_t)len;
+        size_t got = fread(chunk, 1, want, from);
+        if (got == 0)
+            break;
+        if (to != NULL)
+            fwrite(chunk, 1, got, to);
+        if (len > 0)
+            len -= (long)got;
+    }
+}
+
+// Key = hash of version, limits, options and every input file (0 if one
+// is unreadable)
+static inline uint64_t cache_key(const cache_config *cache, const char **paths, int count)
+{
+    uint64_t hash = 0xcbf29ce484222325ULL;
+    hash = hash_bytes(hash, cache->version, strlen(cache->version) + 1);
+
+    // Builds with different table sizes can produce different output
+    hash = hash_bytes(hash, cache->limits, sizeof cache->limits);
+    hash = hash_bytes(hash, cache->options, strlen(cache->options) + 1);
+
+    for (int i = 0; i < count; i++)
+    {
+        FILE *f = fopen(paths[i], "rb");
+        if (f == NULL)
+            return 0;
+
+        char chunk[8192];
+        size_t got;
+        long total = 0;
+        while ((got = fread(chunk, 1, sizeof chunk, f)) > 0)
+        {
+            hash = hash_bytes(hash, chunk, got);
+            total += (long)got;
+        }
+        fclose(f);
+
+        // Separate the files so moving bytes between them changes the key
+        hash = hash_bytes(hash, &total, sizeof total);
+    }
+
+    return hash != 0 ? hash : 1;
+}
+
+// Hit/miss/eviction counters (hit: 1, miss: 0, -1: neither)
+static inline void cache_count(const cache_config *cache, int hit, int evictions)
+{
+    char path[4096];
+    long hits = 0, misses = 0, evicted = 0;
+    snprintf(path, sizeof path, "%s/%s", cache->dir, cache->stats_name);
+
+    FILE *f = fopen(path, "r");
+    if (f != NULL)
+    {
+        if (fscanf(f, "hits %ld misses %ld evictions %ld", &hits, &misses, &evicted) != 3)
+            hits = misses = evicted = 0;
+        fclose(f);
+    }
+
+    if (hit == 1)
+        hits++;
+    else if (hit == 0)
+        misses++;
+    evicted += evictions;
+
+    f = fopen(path, "w");
+    if (f != NULL)
+    {
+        fprintf(f, "hits %ld\nmisses %ld\nevictions %ld\n", hits, misses, evicted);
+        fclose(f);
+    }
+}
+
+static inline int compare_cache_entries(const void *a, const void *b)
+{
+    const cache_entry *x = a, *y = b;
+    return (x->used > y->used) - (x->used < y->used);
+}
+
+// Drop least recently used entries until the directory fits max_size
+static inline void cache_evict(const cache_config *cache)
+{
+    DIR *dir = opendir(cache->dir);
+    if (dir == NULL)
+        return;
+
+    cache_entry *entries = NULL;
+    int count = 0, capacity = 0;
+    long total = 0;
+    struct dirent *d;
+    while ((d = readdir(dir)) != NULL)
+    {
+        size_t n = strlen(d->d_name);
+        if (n < 5 || n >= sizeof entries[0].name || strcmp(d->d_name + n - 5, ".pl0c") != 0)
+            continue;
+
+        char path[4400];
+        struct stat st;
+        snprintf(path, sizeof path, "%s/%s", cache->dir, d->d_name);
+        if (stat(path, &st) != 0)
+            continue;
+
+        if (count == capacity)
+        {
+            capacity = capacity ? capacity * 2 : 64;
+            cache_entry *grown = realloc(entries, (size_t)capacity * sizeof *entries);
+            if (grown == NULL)
+                break;
+            entries = grown;
+        }
+        strcpy(entries[count].name, d->d_name);
+        entries[count].size = (long)st.st_size;
+        entries[count].used = st.st_mtime;
+        total += entries[count].size;
+        count++;
+    }
+    closedir(dir);
+
+    int evicted = 0;
+    if (total > cache->max_size)
+    {
+        qsort(entries, (size_t)count, sizeof *entries, compare_cache_entries);
+        for (int i = 0; i < count && total > cache->max_size; i++)
+        {
+            char path[4400];
+            snprintf(path, sizeof path, "%s/%s", cache->dir, entries[i].name);
+            if (remove(path) == 0)
+            {
+                total -= entries[i].size;
+                evicted++;
+            }
+        }
+    }
+    free(entries);
+
+    if (evicted > 0)
+        cache_count(cache, -1, evicted);
+}
+
+// Replay the entry for key, if there is one: listing to stdout, then the
+// artifacts. Returns 1 on a hit
+static inline int cache_lookup(const cache_config *cache, uint64_t key, const char **artifacts, int count)
+{
+    char path[4096];
+    snprintf(path, sizeof path, "%s/%016llx.pl0c", cache->dir, (unsigned long long)key);
+
+    FILE *entry = fopen(path, "rb");
+    if (entry == NULL)
+        return 0;
+
+    long listing_len, lengths[CACHE_MAX_ARTIFACTS];
+    int stored;
+    int ok = fscanf(entry, "PL0CACHE2 %ld %d", &listing_len, &stored) == 2 && stored == count;
+    for (int i = 0; ok && i < count; i++)
+        ok = fscanf(entry, "%ld", &lengths[i]) == 1;
+    if (!ok || fgetc(entry) != '\n')
+    {
+        fclose(entry);
+        return 0;
+    }
+
+    copy_bytes(entry, stdout, listing_len);
+    for (int i = 0; i < count; i++)
+    {
+        FILE *out = fopen(artifacts[i], "wb");
+        copy_bytes(entry, out, lengths[i]);
+        if (out != NULL)
+            fclose(out);
+    }
+    fclose(entry);
+
+    // Touch the entry so eviction sees it as recently used
+    utime(path, NULL);
+    cache_count(cache, 1, 0);
+    return 1;
+}
+
+// Store the listing (a temporary file) and the artifacts under key
+static inline void cache_store(const cache_config *cache, uint64_t key, FILE *listing, const char **artifacts, int count)
+{
+    mkdir(cache->dir, 0777);
+
+    FILE *in[CACHE_MAX_ARTIFACTS];
+    long lengths[CACHE_MAX_ARTIFACTS];
+    for (int i = 0; i < count; i++)
+    {
+        in[i] = fopen(artifacts[i], "rb");
+        if (in[i] == NULL)
+        {
+            while (i-- > 0)
+                fclose(in[i]);
+            return;
+        }
+        fseek(in[i], 0, SEEK_END);
+        lengths[i] = ftell(in[i]);
+        rewind(in[i]);
+    }
+
+    fflush(listing);
+    fseek(listing, 0, SEEK_END);
+    long listing_len = ftell(listing);
+
+    char path[4096], tmp_path[4200];
+    snprintf(path, sizeof path, "%s/%016llx.pl0c", cache->dir, (unsigned long long)key);
+    snprintf(tmp_path, sizeof tmp_path, "%s.%ld.tmp", path, (long)getpid());
+
+    FILE *entry = fopen(tmp_path, "wb");
+    if (entry != NULL)
+    {
+        fprintf(entry, "PL0CACHE2 %ld %d", listing_len, count);
+        for (int i = 0; i < count; i++)
+            fprintf(entry, " %ld", lengths[i]);
+        fprintf(entry, "\n");
+
+        rewind(listing);
+        copy_bytes(listing, entry, listing_len);
+        for (int i = 0; i < count; i++)
+            copy_bytes(in[i], entry, lengths[i]);
+
+        // Publish atomically so concurrent readers never see a partial entry
+        if (fclose(entry) == 0 && rename(tmp_path, path) == 0)
+            cache_evict(cache);
+        else
+            remove(tmp_path);
+        cache_count(cache, 0, 0);
+    }
+
+    for (int i = 0; i < count; i++)
+        fclose(in[i]);
+}
+
+#endif
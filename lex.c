@@ -8,19 +8,58 @@ To Compile:
 Scanner:
 gcc -O2 -std=c11 -o lex lex.c
 
+Scanner with the table-driven scanner (--table):
+gcc -O2 -std=c11 -o scangen scangen.c && ./scangen > scantab.h
+gcc -O2 -std=c11 -DLEX_TABLE_SCANNER -o lex lex.c
+
 Parser/Code Generator:
 gcc -O2 -std=c11 -o parsercodegen parsercodegen.c
 
+Scanner and parser in one binary, for --pipeline:
+gcc -O2 -std=c11 -pthread -DPL0_PIPELINE -o pl0c parsercodegen.c lex.c
+
 To Execute (on Eustis):
-./lex <input_file.txt>
-./parsercodegen
+./lex [-g] [--intern] [--table] [--cache <dir>] [--cache-size <bytes>] [--stats[=json]] [--perf] <input_file.txt>
+./lex --stream [-g] [--intern] [--table] [--stats[=json]] [--perf] [<input_file.txt> | -]
+./parsercodegen [-g] [--cache <dir>] [--cache-size <bytes>] [--stats[=json]] [--perf]
 
 where:
 <input_file.txt> is the path to the PL/0 source program
+<dir> is a compilation cache directory shared by both programs
 
 Notes:
-- lex.c accepts ONE command-line argument (input PL/0 source file)
-- parsercodegen.c accepts NO command-line arguments
+- lex.c accepts ONE required command-line argument (input PL/0 source file)
+- parsercodegen.c accepts NO required command-line arguments
+- --cache keys each run by a hash of its input bytes and options and replays
+  the stored listing and output file on a hit (LRU-evicted past --cache-size,
+  see cache.h)
+- -g also writes tokens.lines, the "line column" of every token in
+  tokens.txt order, for parsercodegen -g to build its line table; a run
+  without -g removes it
+- --stream scans stdin (or the file given, "-" for stdin) through a fixed
+  64 KB buffer and writes tokens.txt as tokens are recognized, so memory
+  does not grow with the input. The listing streams the lexeme table and
+  skips the source echo and token list; --cache is not used
+- --intern looks every word up once in a hash table seeded with the
+  keywords (no isKeyword chain) and gives identifiers dense ids in order
+  of first appearance. tokens.txt then carries "2 <id>" for identifiers,
+  with "0 <name>" written just before an id's first use to define it;
+  parsercodegen reads either form
+- "case" and "of" are keywords too (casesym, ofsym: parsercodegen's case
+  statement), numbered after the assignment's tokens
+- --table (builds with -DLEX_TABLE_SCANNER only) scans with the DFA that
+  scangen.c generates into scantab.h: a byte -> class map and a state
+  table walked once per character, keywords included, in place of the
+  if/else chain. Output is identical; bench/scan.sh compares the two
+- Built with -DPL0_PIPELINE this file has no main and provides the
+  scanner thread of parsercodegen --pipeline (lexPipeline, see pipeline.h)
+- --stats reports wall time per phase (cache, read, scan, write), token
+  counts by type, isKeyword calls and peak RSS to stderr; --stats=json
+  prints the same as one JSON object
+- --perf adds hardware counters to --stats (text unless --stats=json):
+  cycles, instructions, IPC, branch, L1d and LLC misses per phase, in
+  total and per token (see perfcount.h). Counters the machine does not
+  offer print as "-" (null in JSON), or "unavailable" with the reason
 - Input filename is hard-coded in parsercodegen.c
 - Implements recursive-descent parser for PL/0 grammar
 - Generates PM/0 assembly code (see Appendix A for ISA)
@@ -31,16 +70,35 @@ Instructor: Dr. Jie Lin
 Due Date: Friday, October 31, 2025 at 11:59 PM ET
 */
 
+#define _POSIX_C_SOURCE 200809L
+#define _DEFAULT_SOURCE // syscall() for perfcount.h
+
 #include <stdio.h>
 #include <stdlib.h>
 #include <ctype.h>
+#include <errno.h>
 #include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <time.h>
+#include <sys/resource.h>
+#include "perfcount.h"
+#include "cache.h"
+#ifdef PL0_PIPELINE
+#include "pipeline.h"
+#endif
 
+#ifndef MAX_TOKENS // raised with -D for benchmark builds
 #define MAX_TOKENS 1000
+#endif
 #define MAX_IDENT_LEN 11
 #define MAX_NUM_LEN 5
+#ifndef MAX_SOURCE_SIZE // raised with -D for benchmark builds
 #define MAX_SOURCE_SIZE 100000
+#endif
 #define MAX_LEXEME_LEN 256
+#define CACHE_VERSION "lex-2"
+#define INPUT_BUFFER_SIZE 65536
 
 // TokenType Enumeration
 typedef enum
@@ -78,57 +136,282 @@ typedef enum
     writesym,
     readsym,
     elsesym,
-    evensym
+    evensym,
+    casesym,
+    ofsym
 } TokenType;
 
+// Generated transition tables for the --table scanner (see scangen.c)
+#ifdef LEX_TABLE_SCANNER
+#include "scantab.h"
+_Static_assert(SCAN_LAST_TOKEN == ofsym, "scantab.h does not match TokenType; rerun scangen");
+#define TABLE_USAGE " [--table]"
+#else
+#define TABLE_USAGE ""
+#endif
+
 // Token structure
 typedef struct
 {
     char lexeme[MAX_LEXEME_LEN];
     TokenType type;
     char error[50];
+    int line;   // source position of the first character
+    int column;
+    int nameId; // interned identifier (--intern); lexeme is left empty
 } Token;
 
+// Interned name (--intern): keywords are seeded with their token type,
+// identifiers get dense ids in order of first appearance
+typedef struct
+{
+    char name[MAX_IDENT_LEN + 1];
+    TokenType type; // identsym, or the keyword's type
+    int id;         // identifiers only
+} InternEntry;
+
 // Globals
 Token tokens[MAX_TOKENS];
 int tokenCount = 0;
 char sourceProgram[MAX_SOURCE_SIZE];
 int sourceLen = 0;
 
+// Compilation cache (disabled unless --cache is given, see cache.h)
+char cacheOptions[MAX_LEXEME_LEN] = "";
+cache_config lexCache = {NULL, CACHE_DEFAULT_SIZE, CACHE_VERSION, "lex.stats", cacheOptions, {MAX_TOKENS, MAX_SOURCE_SIZE}};
+
+// Source position tracking (tokens.lines is written only with -g)
+int debugInfo = 0;
+int currentLine = 1, currentColumn = 0, previousColumn = 0;
+int tokenLine = 0, tokenColumn = 0;
+
+// Refillable input buffer behind nextChar; the only source storage in --stream mode
+char inputBuffer[INPUT_BUFFER_SIZE];
+size_t inputPos = 0, inputLen = 0;
+long inputBytes = 0;
+
+// Streaming mode (--stream): tokens go to tokens.txt as they are recognized
+int streamMode = 0;
+
+// Scan with the generated DFA instead of lexicalAnalyzer's if/else chain
+int tableMode = 0;
+
+#ifdef PL0_PIPELINE
+// Scanner thread of parsercodegen --pipeline: tokens go to this ring
+pipe_ring *pipeRing = NULL;
+#endif
+FILE *streamTokens = NULL, *streamLines = NULL;
+long streamTypeCounts[ofsym + 1];
+
+// Intern table: open addressing over internSlots (a power of two, at most
+// half full) plus the id -> name array used to materialize names
+int internMode = 0;
+InternEntry *internSlots = NULL;
+int internCapacity = 0, internUsed = 0;
+char (*internNames)[MAX_IDENT_LEN + 1] = NULL;
+int internNameCount = 0, internNameCapacity = 0;
+int namesWritten = 0; // ids already defined in the token file being written
+long internProbes = 0;
+
+// Statistics (--stats prints text, --stats=json one JSON object, to stderr)
+#define STATS_TEXT 1
+#define STATS_JSON 2
+int statsFormat = 0;
+double cacheSeconds = 0, readSeconds = 0, scanSeconds = 0, writeSeconds = 0;
+long keywordChecks = 0;
+
+// Hardware counters (--perf, see perfcount.h), read wherever the clock is
+#define PERF_CACHE 0
+#define PERF_READ 1
+#define PERF_SCAN 2
+#define PERF_WRITE 3
+int perfMode = 0;
+perf_counters perfCounters;
+long long perfStart[PERF_EVENTS];
+long long perfPhase[4][PERF_EVENTS];
+
 // Prototypes
 void lexicalAnalyzer(FILE *source);
+#ifdef LEX_TABLE_SCANNER
+void tableScanner(FILE *source);
+void scannedToken(const char *buffer, int len, int type);
+#endif
 TokenType isKeyword(const char *word);
 void addToken(const char *lexeme, TokenType type, const char *error);
-void printOutput();
+void printOutput(FILE *out);
 void readSourceProgram(FILE *source);
 const char *tokenName(TokenType type);
+int nextChar(FILE *source);
+void pushBack(int ch, FILE *source);
+size_t refillInput(FILE *source);
+void streamToken(const char *lexeme, TokenType type, const char *error, int nameId);
+void writeToken(FILE *f, TokenType type, const char *lexeme, const char *error, int nameId, int first);
+const char *tokenLexeme(int i);
 
-// Main
+// Identifier interning (--intern)
+void internInit();
+InternEntry *internLookup(const char *name);
+void addIdentifier(const char *name);
+int streamSource(const char *inputPath);
+#ifdef PL0_PIPELINE
+void lexPipeline(FILE *source, pipe_ring *ring);
+void pipeToken(const char *lexeme, TokenType type, const char *error, int nameId);
+#endif
+
+// Statistics
+double statsClock();
+void printStats(FILE *out, const char *cacheResult);
+void perfBegin();
+void perfEnd(int phase);
+void printPerf(FILE *out);
+
+// Main (linked into parsercodegen with -DPL0_PIPELINE, which has its own)
+#ifndef PL0_PIPELINE
 int main(int argc, char *argv[])
 {
-    if (argc != 2)
+    const char *inputPath = NULL;
+    int badArgs = 0;
+
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "-g") == 0)
+            debugInfo = 1;
+        else if (strcmp(argv[i], "--cache") == 0 && i + 1 < argc)
+            lexCache.dir = argv[++i];
+        else if (strcmp(argv[i], "--cache-size") == 0 && i + 1 < argc)
+            lexCache.max_size = atol(argv[++i]);
+        else if (strcmp(argv[i], "--stats") == 0)
+            statsFormat = STATS_TEXT;
+        else if (strcmp(argv[i], "--stats=json") == 0)
+            statsFormat = STATS_JSON;
+        else if (strcmp(argv[i], "--perf") == 0)
+            perfMode = 1;
+        else if (strcmp(argv[i], "--stream") == 0)
+            streamMode = 1;
+        else if (strcmp(argv[i], "--intern") == 0)
+            internMode = 1;
+#ifdef LEX_TABLE_SCANNER
+        else if (strcmp(argv[i], "--table") == 0)
+            tableMode = 1;
+#endif
+        else if (strcmp(argv[i], "-") == 0 && streamMode && inputPath == NULL)
+            inputPath = argv[i];
+        else if (argv[i][0] == '-' || inputPath != NULL)
+            badArgs = 1;
+        else
+            inputPath = argv[i];
+    }
+
+    if (badArgs || (inputPath == NULL && !streamMode))
     {
-        printf("Usage: ./lex <input file>\n");
+        printf("Usage: ./lex [-g] [--intern]" TABLE_USAGE " [--cache <dir>] [--cache-size <bytes>] [--stats[=json]] [--perf] <input file>\n"
+               "       ./lex --stream [-g] [--intern]" TABLE_USAGE " [--stats[=json]] [--perf] [<input file> | -]\n");
         return 1;
     }
 
-    FILE *source = fopen(argv[1], "r");
+    // Options that change the output are part of the cache key. They are
+    // added once each, after parsing, so repeating them cannot overflow
+    // cacheOptions
+    if (debugInfo)
+        strcat(cacheOptions, " -g");
+    if (internMode)
+        strcat(cacheOptions, " --intern");
+
+    // A tokens.lines left by an earlier -g run would be paired with this
+    // run's tokens.txt by parsercodegen -g
+    if (!debugInfo)
+        remove("tokens.lines");
+
+    // --perf reports through --stats, as text unless json was asked for
+    if (perfMode)
+    {
+        if (!statsFormat)
+            statsFormat = STATS_TEXT;
+        for (int p = 0; p < 4; p++)
+            for (int e = 0; e < PERF_EVENTS; e++)
+                perfPhase[p][e] = -1;
+        perf_open(&perfCounters, 0);
+    }
+
+    if (internMode)
+        internInit();
+
+    if (streamMode)
+        return streamSource(inputPath);
+
+    // On a cache hit the listing and token files are replayed without scanning
+    const char *artifacts[] = {"tokens.txt", "tokens.lines"};
+    int numArtifacts = debugInfo ? 2 : 1;
+    uint64_t key = 0;
+    double start = statsClock();
+    perfBegin();
+    if (lexCache.dir != NULL)
+    {
+        key = cache_key(&lexCache, &inputPath, 1);
+        int hit = key != 0 && cache_lookup(&lexCache, key, artifacts, numArtifacts);
+        cacheSeconds = statsClock() - start;
+        perfEnd(PERF_CACHE);
+        if (hit)
+        {
+            if (statsFormat)
+                printStats(stderr, "hit");
+            return 0;
+        }
+    }
+
+    FILE *source = fopen(inputPath, "r");
     if (source == NULL)
     {
         perror("Error opening file");
         return 1;
     }
 
+    start = statsClock();
+    perfBegin();
     readSourceProgram(source);
     fseek(source, 0, SEEK_SET);
+    readSeconds = statsClock() - start;
+    perfEnd(PERF_READ);
 
+    start = statsClock();
+    perfBegin();
     lexicalAnalyzer(source);
     fclose(source);
+    scanSeconds = statsClock() - start;
+    perfEnd(PERF_SCAN);
+
+    // Capture the listing so a miss can be stored alongside tokens.txt
+    FILE *listing = NULL;
+    if (key != 0)
+        listing = tmpfile();
+
+    start = statsClock();
+    perfBegin();
+    printOutput(listing != NULL ? listing : stdout);
+    writeSeconds = statsClock() - start;
+    perfEnd(PERF_WRITE);
+
+    if (listing != NULL)
+    {
+        start = statsClock();
+        perfBegin();
+        cache_store(&lexCache, key, listing, artifacts, numArtifacts);
+        cacheSeconds += statsClock() - start;
+        perfEnd(PERF_CACHE);
+
+        rewind(listing);
+        int ch;
+        while ((ch = fgetc(listing)) != EOF)
+            putchar(ch);
+        fclose(listing);
+    }
 
-    printOutput();
+    if (statsFormat)
+        printStats(stderr, lexCache.dir != NULL ? "miss" : "off");
 
     return 0;
 }
+#endif
 
 // Read entire source program
 void readSourceProgram(FILE *source)
@@ -141,6 +424,58 @@ void readSourceProgram(FILE *source)
     sourceProgram[sourceLen] = '\0';
 }
 
+// Refill inputBuffer from the start. A stream takes whatever read() has
+// ready so tokens flow while a pipe is still being written
+size_t refillInput(FILE *source)
+{
+    inputPos = 0;
+    if (!streamMode)
+        inputLen = fread(inputBuffer, 1, sizeof inputBuffer, source);
+    else
+    {
+        ssize_t got;
+        do
+            got = read(fileno(source), inputBuffer, sizeof inputBuffer);
+        while (got < 0 && errno == EINTR);
+        inputLen = got > 0 ? (size_t)got : 0;
+    }
+    inputBytes += (long)inputLen;
+    return inputLen;
+}
+
+// Read one character, tracking the line and column it came from
+int nextChar(FILE *source)
+{
+    if (inputPos == inputLen && refillInput(source) == 0)
+        return EOF;
+
+    int ch = (unsigned char)inputBuffer[inputPos++];
+    if (ch == '\n')
+    {
+        previousColumn = currentColumn;
+        currentLine++;
+        currentColumn = 0;
+    }
+    else if (ch != EOF)
+        currentColumn++;
+    return ch;
+}
+
+// Undo the last nextChar (one character of lookahead; the character is
+// still in inputBuffer, since a refill only happens before a read)
+void pushBack(int ch, FILE *source)
+{
+    (void)source;
+    inputPos--;
+    if (ch == '\n')
+    {
+        currentLine--;
+        currentColumn = previousColumn;
+    }
+    else
+        currentColumn--;
+}
+
 // Lexical analysis
 void lexicalAnalyzer(FILE *source)
 {
@@ -149,12 +484,24 @@ void lexicalAnalyzer(FILE *source)
     int bufferIndex = 0;
     int inComment = 0;
 
-    while ((ch = fgetc(source)) != EOF)
+#ifdef LEX_TABLE_SCANNER
+    if (tableMode)
+    {
+        tableScanner(source);
+        return;
+    }
+#endif
+
+    while ((ch = nextChar(source)) != EOF)
     {
+        // Every token starts at the character just read
+        tokenLine = currentLine;
+        tokenColumn = currentColumn;
+
         // Handle comments
         if (!inComment && ch == '/')
         {
-            int next = fgetc(source);
+            int next = nextChar(source);
             if (next == '*')
             {
                 // Add /* delimiters as tokens
@@ -166,7 +513,7 @@ void lexicalAnalyzer(FILE *source)
             else
             {
                 if (next != EOF)
-                    ungetc(next, source); // guard
+                    pushBack(next, source); // guard
                 addToken("/", slashsym, NULL);
                 continue;
             }
@@ -176,7 +523,7 @@ void lexicalAnalyzer(FILE *source)
         {
             if (ch == '*')
             {
-                int next = fgetc(source);
+                int next = nextChar(source);
                 if (next == '/')
                 {
                     // Add */ delimiters as tokens
@@ -187,7 +534,7 @@ void lexicalAnalyzer(FILE *source)
                 else
                 {
                     if (next != EOF)
-                        ungetc(next, source); // guard
+                        pushBack(next, source); // guard
                 }
             }
             continue;
@@ -202,17 +549,26 @@ void lexicalAnalyzer(FILE *source)
         {
             bufferIndex = 0;
             buffer[bufferIndex++] = ch;
-            while ((ch = fgetc(source)) != EOF && (isalnum(ch)))
+            while ((ch = nextChar(source)) != EOF && (isalnum(ch)))
             {
                 if (bufferIndex < MAX_LEXEME_LEN - 1)
                     buffer[bufferIndex++] = ch;
             }
             buffer[bufferIndex] = '\0';
             if (ch != EOF)
-                ungetc(ch, source); // guard
+                pushBack(ch, source); // guard
 
             if (bufferIndex > MAX_IDENT_LEN)
                 addToken(buffer, skipsym, "Identifier too long");
+            else if (internMode)
+            {
+                // One hash probe answers both "keyword?" and "which name?"
+                InternEntry *entry = internLookup(buffer);
+                if (entry->type != identsym)
+                    addToken(buffer, entry->type, NULL);
+                else
+                    addIdentifier(entry->name);
+            }
             else
             {
                 TokenType keywordType = isKeyword(buffer);
@@ -227,14 +583,14 @@ void lexicalAnalyzer(FILE *source)
         {
             bufferIndex = 0;
             buffer[bufferIndex++] = ch;
-            while ((ch = fgetc(source)) != EOF && isdigit(ch))
+            while ((ch = nextChar(source)) != EOF && isdigit(ch))
             {
                 if (bufferIndex < MAX_LEXEME_LEN - 1)
                     buffer[bufferIndex++] = ch;
             }
             buffer[bufferIndex] = '\0';
             if (ch != EOF)
-                ungetc(ch, source); // guard
+                pushBack(ch, source); // guard
 
             if (bufferIndex > MAX_NUM_LEN)
                 addToken(buffer, skipsym, "Number too long");
@@ -252,7 +608,7 @@ void lexicalAnalyzer(FILE *source)
             addToken("=", eqsym, NULL);
         else if (ch == '<')
         {
-            int next = fgetc(source);
+            int next = nextChar(source);
             if (next == '>')
                 addToken("<>", neqsym, NULL);
             else if (next == '=')
@@ -260,31 +616,31 @@ void lexicalAnalyzer(FILE *source)
             else
             {
                 if (next != EOF)
-                    ungetc(next, source); // guard
+                    pushBack(next, source); // guard
                 addToken("<", lessym, NULL);
             }
         }
         else if (ch == '>')
         {
-            int next = fgetc(source);
+            int next = nextChar(source);
             if (next == '=')
                 addToken(">=", geqsym, NULL);
             else
             {
                 if (next != EOF)
-                    ungetc(next, source); // guard
+                    pushBack(next, source); // guard
                 addToken(">", gtrsym, NULL);
             }
         }
         else if (ch == ':')
         {
-            int next = fgetc(source);
+            int next = nextChar(source);
             if (next == '=')
                 addToken(":=", becomessym, NULL);
             else
             {
                 if (next != EOF)
-                    ungetc(next, source); // guard
+                    pushBack(next, source); // guard
                 char invalidChar[2] = {ch, '\0'};
                 addToken(invalidChar, skipsym, "Invalid symbol");
             }
@@ -307,9 +663,103 @@ void lexicalAnalyzer(FILE *source)
     }
 }
 
+#ifdef LEX_TABLE_SCANNER
+// Table-driven scanner (--table): one class lookup and one transition per
+// character, reading inputBuffer directly. A character with no transition
+// ends the token and is scanned again from the state the token resumes
+// in, so the tokens, lexemes and positions are exactly those of the
+// hand-written scanner above. Columns come from the offset of the last
+// newline rather than a per-character counter
+void tableScanner(FILE *source)
+{
+    char buffer[MAX_LEXEME_LEN];
+    int len = 0;
+    int state = SCAN_START;
+    int line = 1;
+    long lineStart = 0;                    // offset of the current line's first character
+    long base = inputBytes - (long)inputLen; // offset of inputBuffer[0]
+    size_t pos = inputPos;
+
+    for (;;)
+    {
+        if (pos == inputLen)
+        {
+            inputPos = pos;
+            if (refillInput(source) == 0)
+                break;
+            pos = 0;
+            base = inputBytes - (long)inputLen;
+        }
+
+        int ch = (unsigned char)inputBuffer[pos];
+        int next = scanNext[state][scanClass[ch]];
+        if (next & SCAN_MARK)
+        {
+            // First character of a token (or of a possible "*/")
+            tokenLine = line;
+            tokenColumn = (int)(base + (long)pos - lineStart + 1);
+            len = 0;
+            next &= ~SCAN_MARK;
+        }
+
+        if (next != 0)
+        {
+            if (len < MAX_LEXEME_LEN - 1)
+                buffer[len++] = ch;
+            state = next;
+            pos++;
+            if (ch == '\n')
+            {
+                line++;
+                lineStart = base + (long)pos;
+            }
+            continue;
+        }
+
+        buffer[len] = '\0';
+        scannedToken(buffer, len, scanAccept[state]);
+        state = scanResume[state];
+        len = 0;
+    }
+
+    buffer[len] = '\0';
+    scannedToken(buffer, len, scanAccept[state]);
+    currentLine = line;
+}
+
+// Report a token the table scanner accepted; 0 is whitespace or the
+// inside of a comment, which report nothing
+void scannedToken(const char *buffer, int len, int type)
+{
+    if (type == 0)
+        return;
+    if (type == SCAN_COMMENT_OPEN)
+    {
+        addToken("/", slashsym, NULL);
+        addToken("*", multsym, NULL);
+    }
+    else if (type == SCAN_COMMENT_CLOSE)
+    {
+        addToken("*", multsym, NULL);
+        addToken("/", slashsym, NULL);
+    }
+    else if (type == skipsym)
+        addToken(buffer, skipsym, "Invalid symbol");
+    else if (type == identsym && len > MAX_IDENT_LEN)
+        addToken(buffer, skipsym, "Identifier too long");
+    else if (type == identsym && internMode)
+        addIdentifier(buffer);
+    else if (type == numbersym && len > MAX_NUM_LEN)
+        addToken(buffer, skipsym, "Number too long");
+    else
+        addToken(buffer, type, NULL);
+}
+#endif
+
 // Keywords
 TokenType isKeyword(const char *word)
 {
+    keywordChecks++;
     if (strcmp(word, "begin") == 0)
         return beginsym;
     if (strcmp(word, "end") == 0)
@@ -340,16 +790,186 @@ TokenType isKeyword(const char *word)
         return elsesym;
     if (strcmp(word, "even") == 0)
         return evensym;
+    if (strcmp(word, "case") == 0)
+        return casesym;
+    if (strcmp(word, "of") == 0)
+        return ofsym;
     return identsym;
 }
 
+// Seed the intern table with the keywords so that interning a word also
+// classifies it
+void internInit()
+{
+    static const char *keywords[] = {"begin", "end", "if", "fi", "then", "while", "do", "call",
+                                     "const", "var", "procedure", "write", "read", "else", "even",
+                                     "case", "of"};
+    internCapacity = 64;
+    internSlots = calloc(internCapacity, sizeof(InternEntry));
+    if (internSlots == NULL)
+    {
+        fprintf(stderr, "Error: out of memory\n");
+        exit(1);
+    }
+    for (size_t i = 0; i < sizeof keywords / sizeof keywords[0]; i++)
+    {
+        InternEntry *entry = internLookup(keywords[i]);
+        entry->type = isKeyword(keywords[i]);
+    }
+    keywordChecks = 0;
+    internProbes = 0;
+}
+
+// Find word, inserting it as a new identifier (id not yet assigned) if it
+// is not there. Empty slots have an empty name
+InternEntry *internLookup(const char *word)
+{
+    size_t len = strlen(word);
+    size_t mask = (size_t)internCapacity - 1;
+    size_t slot = (size_t)hash_bytes(0xcbf29ce484222325ULL, word, len) & mask;
+    internProbes++;
+    while (internSlots[slot].name[0] != '\0')
+    {
+        if (strcmp(internSlots[slot].name, word) == 0)
+            return &internSlots[slot];
+        slot = (slot + 1) & mask;
+        internProbes++;
+    }
+
+    if (2 * (internUsed + 1) > internCapacity)
+    {
+        // Rehash into twice the slots, then insert into the new table
+        InternEntry *old = internSlots;
+        int oldCapacity = internCapacity;
+        internCapacity *= 2;
+        internSlots = calloc(internCapacity, sizeof(InternEntry));
+        if (internSlots == NULL)
+        {
+            fprintf(stderr, "Error: out of memory\n");
+            exit(1);
+        }
+        mask = (size_t)internCapacity - 1;
+        for (int i = 0; i < oldCapacity; i++)
+        {
+            if (old[i].name[0] == '\0')
+                continue;
+            size_t to = (size_t)hash_bytes(0xcbf29ce484222325ULL, old[i].name, strlen(old[i].name)) & mask;
+            while (internSlots[to].name[0] != '\0')
+                to = (to + 1) & mask;
+            internSlots[to] = old[i];
+        }
+        free(old);
+        slot = (size_t)hash_bytes(0xcbf29ce484222325ULL, word, len) & mask;
+        while (internSlots[slot].name[0] != '\0')
+            slot = (slot + 1) & mask;
+    }
+
+    memcpy(internSlots[slot].name, word, len + 1);
+    internSlots[slot].type = identsym;
+    internSlots[slot].id = -1;
+    internUsed++;
+    return &internSlots[slot];
+}
+
+// Identifier token in intern mode: only the id is stored, the name lives
+// once in internNames
+void addIdentifier(const char *name)
+{
+    InternEntry *entry = internLookup(name);
+    if (entry->id < 0)
+    {
+        if (internNameCount == internNameCapacity)
+        {
+            internNameCapacity = internNameCapacity == 0 ? 256 : 2 * internNameCapacity;
+            internNames = realloc(internNames, internNameCapacity * sizeof *internNames);
+            if (internNames == NULL)
+            {
+                fprintf(stderr, "Error: out of memory\n");
+                exit(1);
+            }
+        }
+        entry->id = internNameCount;
+        strcpy(internNames[internNameCount++], name);
+    }
+
+    if (streamMode)
+    {
+        streamToken(name, identsym, NULL, entry->id);
+        return;
+    }
+#ifdef PL0_PIPELINE
+    if (pipeRing != NULL)
+    {
+        pipeToken(name, identsym, NULL, entry->id);
+        return;
+    }
+#endif
+
+    if (tokenCount < MAX_TOKENS)
+    {
+        tokens[tokenCount].lexeme[0] = '\0';
+        tokens[tokenCount].nameId = entry->id;
+        tokens[tokenCount].type = identsym;
+        tokens[tokenCount].line = tokenLine;
+        tokens[tokenCount].column = tokenColumn;
+        tokens[tokenCount].error[0] = '\0';
+        tokenCount++;
+    }
+}
+
+// Lexeme of token i, looking interned identifiers up by id
+const char *tokenLexeme(int i)
+{
+    if (tokens[i].nameId >= 0)
+        return internNames[tokens[i].nameId];
+    return tokens[i].lexeme;
+}
+
+// One token in tokens.txt format. An interned identifier is written as
+// "2 <id>"; the first time an id is written it is preceded by "0 <name>",
+// which defines it for the parser
+void writeToken(FILE *f, TokenType type, const char *lexeme, const char *error, int nameId, int first)
+{
+    if (!first)
+        fputc(' ', f);
+    if (nameId >= 0)
+    {
+        if (nameId == namesWritten)
+        {
+            fprintf(f, "0 %s ", internNames[nameId]);
+            namesWritten++;
+        }
+        fprintf(f, "%d %d", type, nameId);
+        return;
+    }
+    fprintf(f, "%d", type);
+    if ((type == identsym || type == numbersym) && error == NULL)
+        fprintf(f, " %s", lexeme);
+}
+
 // Add a token
 void addToken(const char *lexeme, TokenType type, const char *error)
 {
+    if (streamMode)
+    {
+        streamToken(lexeme, type, error, -1);
+        return;
+    }
+#ifdef PL0_PIPELINE
+    if (pipeRing != NULL)
+    {
+        pipeToken(lexeme, type, error, -1);
+        return;
+    }
+#endif
+
     if (tokenCount < MAX_TOKENS)
     {
         strcpy(tokens[tokenCount].lexeme, lexeme);
+        tokens[tokenCount].nameId = -1;
         tokens[tokenCount].type = type;
+        tokens[tokenCount].line = tokenLine;
+        tokens[tokenCount].column = tokenColumn;
         if (error != NULL)
             strcpy(tokens[tokenCount].error, error);
         else
@@ -431,41 +1051,45 @@ const char *tokenName(TokenType type)
         return "elsesym";
     case evensym:
         return "evensym";
+    case casesym:
+        return "casesym";
+    case ofsym:
+        return "ofsym";
     default:
         return "UNKNOWN";
     }
 }
 
-void printOutput()
+void printOutput(FILE *out)
 {
-    printf("\nSource Program:\n\n");
-    printf("%s\n", sourceProgram);
+    fprintf(out, "\nSource Program:\n\n");
+    fprintf(out, "%s\n", sourceProgram);
 
-    printf("\nLexeme Table:\n\n");
-    printf("lexeme\t\ttoken type\n");
+    fprintf(out, "\nLexeme Table:\n\n");
+    fprintf(out, "lexeme\t\ttoken type\n");
 
     for (int i = 0; i < tokenCount; i++)
     {
-        printf("%s\t\t", tokens[i].lexeme);
+        fprintf(out, "%s\t\t", tokenLexeme(i));
         if (tokens[i].error[0] != '\0')
-            printf("%s", tokens[i].error);
+            fprintf(out, "%s", tokens[i].error);
         else
-            printf("%d", tokens[i].type); // print numeric code
-        printf("\n");
+            fprintf(out, "%d", tokens[i].type); // print numeric code
+        fprintf(out, "\n");
     }
 
-    printf("\nToken List:\n\n");
+    fprintf(out, "\nToken List:\n\n");
     for (int i = 0; i < tokenCount; i++)
     {
-        printf("%d", tokens[i].type);
+        fprintf(out, "%d", tokens[i].type);
         if ((tokens[i].type == identsym || tokens[i].type == numbersym) && tokens[i].error[0] == '\0')
         {
-            printf(" %s", tokens[i].lexeme);
+            fprintf(out, " %s", tokenLexeme(i));
         }
         if (i < tokenCount - 1)
-            printf(" ");
+            fprintf(out, " ");
     }
-    printf("\n");
+    fprintf(out, "\n");
 
     /* Also write the numeric token stream to a hard-coded tokens.txt file
        so parsercodegen can open it without requiring redirection. */
@@ -473,15 +1097,8 @@ void printOutput()
     if (tokf != NULL)
     {
         for (int i = 0; i < tokenCount; i++)
-        {
-            fprintf(tokf, "%d", tokens[i].type);
-            if ((tokens[i].type == identsym || tokens[i].type == numbersym) && tokens[i].error[0] == '\0')
-            {
-                fprintf(tokf, " %s", tokens[i].lexeme);
-            }
-            if (i < tokenCount - 1)
-                fprintf(tokf, " ");
-        }
+            writeToken(tokf, tokens[i].type, tokens[i].lexeme,
+                       tokens[i].error[0] != '\0' ? tokens[i].error : NULL, tokens[i].nameId, i == 0);
         fprintf(tokf, "\n");
         fclose(tokf);
     }
@@ -489,4 +1106,275 @@ void printOutput()
     {
         perror("Error creating tokens.txt");
     }
-}
\ No newline at end of file
+
+    // Positions line up one-to-one with the tokens written above
+    if (debugInfo)
+    {
+        FILE *linef = fopen("tokens.lines", "w");
+        if (linef != NULL)
+        {
+            for (int i = 0; i < tokenCount; i++)
+                fprintf(linef, "%d %d\n", tokens[i].line, tokens[i].column);
+            fclose(linef);
+        }
+        else
+        {
+            perror("Error creating tokens.lines");
+        }
+    }
+}
+
+// --stream: scan stdin (or a file) through inputBuffer and write each
+// token as it is recognized; nothing grows with the input. The listing
+// has no source echo and the lexeme table is streamed; the token list is
+// tokens.txt itself. The cache needs the whole input up front, so it is
+// not used here
+int streamSource(const char *inputPath)
+{
+    FILE *source = stdin;
+    if (inputPath != NULL && strcmp(inputPath, "-") != 0)
+        source = fopen(inputPath, "r");
+    if (source == NULL)
+    {
+        perror("Error opening file");
+        return 1;
+    }
+
+    streamTokens = fopen("tokens.txt", "w");
+    if (streamTokens == NULL)
+    {
+        perror("Error creating tokens.txt");
+        return 1;
+    }
+    if (debugInfo)
+    {
+        streamLines = fopen("tokens.lines", "w");
+        if (streamLines == NULL)
+        {
+            perror("Error creating tokens.lines");
+            return 1;
+        }
+    }
+
+    printf("\nLexeme Table:\n\n");
+    printf("lexeme\t\ttoken type\n");
+
+    double start = statsClock();
+    perfBegin();
+    lexicalAnalyzer(source);
+    scanSeconds = statsClock() - start;
+    perfEnd(PERF_SCAN);
+    if (source != stdin)
+        fclose(source);
+
+    fprintf(streamTokens, "\n");
+    fclose(streamTokens);
+    if (streamLines != NULL)
+        fclose(streamLines);
+
+    printf("\nToken List:\n\n%d tokens written to tokens.txt\n", tokenCount);
+
+    if (statsFormat)
+        printStats(stderr, "off");
+    return 0;
+}
+
+// Token sink for --stream: one lexeme table row on stdout and the token in
+// tokens.txt (and tokens.lines), in the same format printOutput uses
+void streamToken(const char *lexeme, TokenType type, const char *error, int nameId)
+{
+    if (error != NULL)
+        printf("%s\t\t%s\n", lexeme, error);
+    else
+        printf("%s\t\t%d\n", lexeme, type);
+
+    writeToken(streamTokens, type, lexeme, error, nameId, tokenCount == 0);
+
+    if (streamLines != NULL)
+        fprintf(streamLines, "%d %d\n", tokenLine, tokenColumn);
+
+    streamTypeCounts[type]++;
+    tokenCount++;
+}
+
+#ifdef PL0_PIPELINE
+// Scanner half of parsercodegen --pipeline, run on its own thread: scan
+// source into ring instead of tokens.txt and finish with an end token.
+// Identifiers are interned, with each name sent once ahead of its first
+// use, the same protocol as --intern's tokens.txt
+void lexPipeline(FILE *source, pipe_ring *ring)
+{
+    pipeRing = ring;
+    internMode = 1;
+    internInit();
+
+    lexicalAnalyzer(source);
+
+    pipe_token end = {-1, 0, 0, 0, ""};
+    pipe_push(ring, &end);
+}
+
+// Token sink for --pipeline: one compact token per push; numbers travel
+// as values and identifiers as ids
+void pipeToken(const char *lexeme, TokenType type, const char *error, int nameId)
+{
+    pipe_token token = {0, 0, 0, 0, ""};
+    if (nameId >= 0 && nameId == namesWritten)
+    {
+        token.value = nameId;
+        strcpy(token.name, internNames[nameId]);
+        pipe_push(pipeRing, &token);
+        token.name[0] = '\0';
+        namesWritten++;
+    }
+
+    token.type = type;
+    if (nameId >= 0)
+        token.value = nameId;
+    else if (type == numbersym && error == NULL)
+        token.value = atoi(lexeme);
+    else
+        token.value = 0;
+    token.line = tokenLine;
+    token.column = tokenColumn;
+    pipe_push(pipeRing, &token);
+}
+#endif
+
+// Monotonic seconds; 0 without --stats
+double statsClock()
+{
+    if (!statsFormat)
+        return 0.0;
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// Report phase times and counters (cacheResult is "off", "hit" or "miss")
+void printStats(FILE *out, const char *cacheResult)
+{
+    const char *phaseNames[] = {"cache", "read", "scan", "write"};
+    double phaseSeconds[] = {cacheSeconds, readSeconds, scanSeconds, writeSeconds};
+    double total = cacheSeconds + readSeconds + scanSeconds + writeSeconds;
+
+    // Token counts come from the finished table, so scanning pays nothing
+    long byType[ofsym + 1] = {0};
+    for (int i = 0; i < tokenCount && !streamMode; i++)
+        byType[tokens[i].type]++;
+    if (streamMode)
+        memcpy(byType, streamTypeCounts, sizeof byType);
+    long sourceBytes = streamMode ? inputBytes : sourceLen;
+
+    struct rusage usage;
+    long peakKb = getrusage(RUSAGE_SELF, &usage) == 0 ? usage.ru_maxrss : 0;
+
+    if (statsFormat == STATS_JSON)
+    {
+        fprintf(out, "{\"program\": \"lex\", \"cache\": \"%s\", \"phases\": {", cacheResult);
+        for (int p = 0; p < 4; p++)
+            fprintf(out, "\"%s\": %.6f, ", phaseNames[p], phaseSeconds[p]);
+        fprintf(out, "\"total\": %.6f}, \"source_bytes\": %ld, \"tokens\": {\"total\": %d", total, sourceBytes, tokenCount);
+        for (int t = skipsym; t <= ofsym; t++)
+        {
+            if (byType[t] > 0)
+                fprintf(out, ", \"%s\": %ld", tokenName(t), byType[t]);
+        }
+        fprintf(out, "}, \"keyword_checks\": %ld", keywordChecks);
+        if (internMode)
+            fprintf(out, ", \"interned_names\": %d, \"intern_probes\": %ld", internNameCount, internProbes);
+        if (perfMode)
+            printPerf(out);
+        fprintf(out, ", \"peak_rss_kb\": %ld}\n", peakKb);
+        return;
+    }
+
+    fprintf(out, "\nlex statistics (cache %s):\n", cacheResult);
+    fprintf(out, "%-20s %12s\n", "phase", "seconds");
+    for (int p = 0; p < 4; p++)
+        fprintf(out, "%-20s %12.6f\n", phaseNames[p], phaseSeconds[p]);
+    fprintf(out, "%-20s %12.6f\n", "total", total);
+
+    fprintf(out, "%-20s %12ld\n", "source bytes", sourceBytes);
+    fprintf(out, "%-20s %12d\n", "tokens", tokenCount);
+    for (int t = skipsym; t <= ofsym; t++)
+    {
+        if (byType[t] > 0)
+            fprintf(out, "  %-18s %12ld\n", tokenName(t), byType[t]);
+    }
+    fprintf(out, "%-20s %12ld calls\n", "isKeyword", keywordChecks);
+    if (internMode)
+    {
+        fprintf(out, "%-20s %12d\n", "interned names", internNameCount);
+        fprintf(out, "%-20s %12ld\n", "intern probes", internProbes);
+    }
+    fprintf(out, "%-20s %12ld KB\n", "peak memory", peakKb);
+    if (perfMode)
+        printPerf(out);
+}
+
+// Start a --perf sample (a no-op without --perf or counters)
+void perfBegin()
+{
+    if (perfCounters.opened > 0)
+        perf_read(&perfCounters, perfStart);
+}
+
+// Add the counts since perfBegin to a phase
+void perfEnd(int phase)
+{
+    if (perfCounters.opened > 0)
+        perf_add(&perfCounters, perfStart, perfPhase[phase]);
+}
+
+// Counters per phase, their total and the total per token: rows of a
+// table, or a ", \"perf\": {...}" member of the --stats=json object
+void printPerf(FILE *out)
+{
+    const char *phaseNames[] = {"cache", "read", "scan", "write"};
+    long long total[PERF_EVENTS];
+    for (int e = 0; e < PERF_EVENTS; e++)
+    {
+        total[e] = -1;
+        for (int p = 0; p < 4; p++)
+        {
+            if (perfPhase[p][e] >= 0)
+                total[e] = (total[e] < 0 ? 0 : total[e]) + perfPhase[p][e];
+        }
+    }
+
+    if (statsFormat == STATS_JSON)
+    {
+        if (perfCounters.opened == 0)
+        {
+            fprintf(out, ", \"perf\": {\"unavailable\": \"%s\"}", perfCounters.reason);
+            return;
+        }
+        fprintf(out, ", \"perf\": {\"phases\": {");
+        for (int p = 0; p < 4; p++)
+        {
+            fprintf(out, "%s\"%s\": ", p > 0 ? ", " : "", phaseNames[p]);
+            perf_print_json(out, perfPhase[p]);
+        }
+        fprintf(out, "}, \"total\": ");
+        perf_print_json(out, total);
+        fprintf(out, ", \"per_token\": ");
+        perf_print_per_json(out, total, tokenCount);
+        fprintf(out, "}");
+        return;
+    }
+
+    if (perfCounters.opened == 0)
+    {
+        fprintf(out, "%-20s unavailable (%s)\n", "counters", perfCounters.reason);
+        return;
+    }
+    perf_print_header(out);
+    for (int p = 0; p < 4; p++)
+    {
+        if (perfPhase[p][PERF_CYCLES] >= 0 || perfPhase[p][PERF_INSTRUCTIONS] >= 0)
+            perf_print_row(out, phaseNames[p], perfPhase[p]);
+    }
+    perf_print_row(out, "total", total);
+    perf_print_per_row(out, "per token", total, tokenCount);
+}
@@ -11,19 +11,104 @@ gcc -O2 -std=c11 -o lex lex.c
 Parser/Code Generator:
 gcc -O2 -std=c11 -o parsercodegen parsercodegen.c
 
+Scanner and parser in one binary, for --pipeline:
+gcc -O2 -std=c11 -pthread -DPL0_PIPELINE -o pl0c parsercodegen.c lex.c
+
 To Execute (on Eustis):
-./lex <input_file.txt>
-./parsercodegen
+./lex [-g] [--intern] [--table] [--cache <dir>] [--cache-size <bytes>] [--stats[=json]] <input_file.txt>
+./lex --stream [-g] [--intern] [--table] [--stats[=json]] [<input_file.txt> | -]
+./parsercodegen [-g] [--cache <dir>] [--cache-size <bytes>] [--simplify] [--constprop]
+                [--dce] [--licm] [--dse] [--profile-use <profile_file>] [--precompute]
+                [--iterative]
+                [--stats[=json]] [--perf]
+./pl0c [parsercodegen options] --pipeline <input_file.txt>
 
 where:
 <input_file.txt> is the path to the PL/0 source program
+<dir> is a compilation cache directory shared by both programs
 
 Notes:
-- lex.c accepts ONE command-line argument (input PL/0 source file)
-- parsercodegen.c accepts NO command-line arguments
+- lex.c accepts ONE required command-line argument (input PL/0 source file)
+- parsercodegen.c accepts NO required command-line arguments
+- --cache keys each run by a hash of its input bytes and options and replays
+  the stored listing and output file on a hit (LRU-evicted past --cache-size,
+  see cache.h)
 - Input filename is hard-coded in parsercodegen.c
 - Implements recursive-descent parser for PL/0 grammar
 - Generates PM/0 assembly code (see Appendix A for ISA)
+- Beyond the assignment's grammar, "case" EXPRESSION "of" LABEL {"," LABEL}
+  "then" STATEMENT {";" ...} ["else" STATEMENT] "end" runs the arm whose
+  label (a number, "-" number or a constant) equals the expression, else
+  the else arm if any. Labels covering at least half of their range
+  compile to a jump table (JTB, opcode 10, which needs vm.c from the same
+  revision), sparser ones to a binary search of compares on a frame slot
+  shared by every case. bench/case.sh compares both with if chains
+- --simplify rewrites expression code algebraically: constant operands
+  are folded, x + 0, x - 0, x * 1, x / 1, 0 + x and 1 * x become x, and
+  x * 0, 0 * x and x - x become 0 when x cannot trap (no DIV by a
+  possibly zero divisor). Multiplying by 2^k becomes OPR 12 (SHL k) and
+  dividing by 2^k OPR 13 (SHR k), which rounds toward zero like DIV, so
+  negative dividends keep their results. Both shifts need vm.c from the
+  same revision
+- --constprop runs a forward data flow over the frame slots on the basic
+  blocks the jumps delimit (a JTB reaches every table entry). A slot is
+  known to hold a constant (after "LIT k; STO"), a copy of another slot
+  (after "LOD y; STO"; a store to y ends it) or varies; where paths meet
+  only what they agree on survives. A LOD of a known constant becomes a
+  LIT and a LOD of a copy loads the original, then LIT LIT OPR and LIT
+  JPC are folded and the flow rerun until nothing folds. Like --dse it
+  only runs on code that keeps to main's frame
+- --dce folds constant conditions and drops unreachable code before output
+- --licm hoists loop-invariant expressions out of while loops into temps
+- --dse runs liveness over the frame slots on the basic blocks the jumps
+  delimit and removes stores whose value is never loaded afterwards,
+  together with the code computing that value when it can neither trap
+  nor read input (a dead "read x" still consumes its integer). Slots no
+  longer loaded or stored are dropped and the rest renumbered from 3, so
+  INC and the symbol table's addresses shrink to the variables in use
+- --precompute runs the finished code in the compiler, with vm.c's
+  semantics (zeroed stack, same arithmetic and stack limit), for up to
+  PRECOMPUTE_STEPS instructions. When it halts without reading input the
+  program becomes JMP, INC 0 3, one "LIT v; SYS 0 1" per value written
+  and the HALT, and variables get address 0. A read, a runtime error
+  (left for the vm to report), an exhausted budget or output that would
+  not fit the code segment keep the normal code, and the listing says why
+- --profile-use reads a PL0PROF profile (vm --profile-data, see vm.c) of
+  this program built with the same flags minus --profile-use. Hot while
+  loops are inverted (the condition is repeated at the bottom, negated,
+  saving the JMP on every iteration) and cold if bodies are moved after
+  the HALT so the common path falls through. A stale profile is matched
+  by line:col when both builds used -g, otherwise ignored with a warning
+- --iterative parses statements and expressions with explicit heap-grown
+  stacks (shunting-yard for expressions) instead of recursive descent, so
+  nesting depth is bounded by memory rather than the C stack. Code and
+  diagnostics are identical to the recursive parser
+- Tokens from lex --intern ("0 <name>" definitions, "2 <id>" identifiers)
+  are looked up by id in O(1) instead of scanning the symbol table
+- --pipeline (pl0c only) skips tokens.txt: lex.c's scanner runs on a
+  second thread and hands compact tokens (type, value, line, column;
+  identifiers interned) to get_next_token through the lock-free ring in
+  pipeline.h, which blocks the scanner while full. A skipsym stops the
+  parse at the same point as reading it from tokens.txt. Listing, elf.txt
+  and elf.lines match lex + parsercodegen with the same flags; --cache is
+  not used. bench/pipeline.sh compares the two
+- -g reads tokens.lines (from lex -g), tags every instruction with the
+  line:column that produced it in the listing, and writes elf.lines:
+  "PL0LINES 2 <instructions> <code checksum>" (the elf.txt it belongs to;
+  vm ignores it next to any other), the row count, then one
+  "<pc delta> <line delta> <column>" row per instruction whose source
+  position differs from the previous one.
+  A tokens.lines without a row for every token is an error, and a build
+  without -g removes elf.lines
+- --stats reports per-phase wall time (cache, read, parse, emit, optimize,
+  print_assembly, write_elf_file), token counts by type, symbol_table_check
+  calls and probe length, emit calls and peak RSS to stderr; --stats=json
+  prints the same as one JSON object. The clock is only read when enabled
+- --perf adds hardware counters to --stats (see perfcount.h): cycles,
+  instructions, IPC, branch, L1d and LLC misses for cache, parse (which
+  includes read and emit: they run once per token, too often to sample),
+  optimize, print_assembly and write_elf_file, in total, per token and
+  per instruction generated. Not part of the cache key
 - All development and testing performed on Eustis
 
 Class: COP3402 - System Software - Fall 2025
@@ -31,14 +116,43 @@ Instructor: Dr. Jie Lin
 Due Date: Friday, October 31, 2025 at 11:59 PM ET
 */
 
+#define _POSIX_C_SOURCE 200809L
+#define _DEFAULT_SOURCE // syscall() for perfcount.h
+
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <ctype.h>
-
+#include <stdint.h>
+#include <unistd.h>
+#include <limits.h>
+#include <time.h>
+#include <sys/resource.h>
+#include "perfcount.h"
+#include "cache.h"
+#ifdef PL0_PIPELINE
+#include <pthread.h>
+#include "pipeline.h"
+#define PIPELINE_USAGE " [--pipeline <source>]"
+#else
+#define PIPELINE_USAGE ""
+#endif
+
+#ifndef MAX_SYMBOL_TABLE_SIZE // raised with -D for benchmark builds
 #define MAX_SYMBOL_TABLE_SIZE 500
+#endif
+#ifndef MAX_CODE_LENGTH // raised with -D for benchmark builds
 #define MAX_CODE_LENGTH 500
+#endif
+#ifndef PRECOMPUTE_STEPS // --precompute's budget; raised with -D for long runs
+#define PRECOMPUTE_STEPS 10000000
+#endif
+#define EVAL_STACK_HEIGHT 100000 // vm.c's MAX_STACK_HEIGHT
 #define MAX_LEXEME_LEN 256
+#define CACHE_VERSION "parsercodegen-2"
+#define CACHE_OPTIONS_LEN 128 // every output option once
+#define PGO_HOT_PERCENT 1 // a loop is hot at >= 1% of the executed instructions
+#define PGO_COLD_RATIO 10 // an if body is cold when entered < 1/10 of the time
 
 // Token types (matching lex.c)
 typedef enum
@@ -76,7 +190,9 @@ typedef enum
     writesym,
     readsym,
     elsesym,
-    evensym
+    evensym,
+    casesym,
+    ofsym
 } TokenType;
 
 // Symbol table structure
@@ -96,28 +212,222 @@ typedef struct
     int op; // opcode
     int l;  // lexicographical level
     int m;  // modifier
+    int line;   // source position that produced it (0 when unknown)
+    int column;
+    long long count; // executions in the --profile-use profile
 } instruction;
 
+// While loop recorded by statement for the loop optimizations
+typedef struct
+{
+    int head; // loop_idx: first instruction of the condition
+    int jpc;  // exit JPC, -1 once folded away
+    int back; // back-edge JMP
+} loop_info;
+
+// Row of a PL0PROF profile (written by vm --profile-data)
+typedef struct
+{
+    int pc;
+    long long count;
+    int line;
+    int column;
+} profile_row;
+
+// How --profile-use matched the profile to this compile
+typedef enum
+{
+    PROFILE_UNUSED,
+    PROFILE_BY_INDEX,   // same code as the profiled elf.txt
+    PROFILE_BY_POSITION // stale profile, matched through -g line:col
+} profile_match;
+
+// Label of a case arm and the first instruction of its statement
+typedef struct
+{
+    int value;
+    int arm;
+} case_label;
+
+// case statement being parsed
+typedef struct
+{
+    int line; // position of the statement, for the dispatch code
+    int column;
+    int arms;        // first instruction of the first arm
+    int first_loop;  // loops[] recorded inside the arms start here
+    int default_arm; // first instruction of the else arm, -1 without one
+    case_label *labels;
+    int num_labels, label_capacity;
+    int *exits; // JMPs to patch with the end of the statement
+    int num_exits, exit_capacity;
+} case_info;
+
+// Open construct on the --iterative statement stack
+typedef enum
+{
+    FRAME_BEGIN,
+    FRAME_IF,
+    FRAME_WHILE,
+    FRAME_CASE
+} frame_kind;
+
+typedef struct
+{
+    frame_kind kind;
+    int line; // position of the statement, for the JPC/JMP it emits
+    int column;
+    int jpc;  // IF/WHILE: JPC to patch
+    int head; // WHILE: first instruction of the condition
+    case_info *case_stmt; // CASE: labels and arms so far
+} statement_frame;
+
+// Pending operator on the --iterative expression stack; subop 0 is "("
+typedef struct
+{
+    int subop;
+    int line;
+    int column;
+} pending_op;
+
+// Phases timed by --stats
+typedef enum
+{
+    PHASE_CACHE,
+    PHASE_READ,
+    PHASE_PARSE,
+    PHASE_EMIT,
+    PHASE_OPTIMIZE,
+    PHASE_PRINT_ASSEMBLY,
+    PHASE_WRITE_ELF_FILE,
+    NUM_PHASES
+} phase_id;
+
+// Counters are plain increments; the clock is only read with --stats
+typedef struct
+{
+    double seconds[NUM_PHASES];
+    long tokens[ofsym + 1]; // indexed by token type
+    long symbol_checks;
+    long symbol_probes; // table entries compared by symbol_table_check
+    long emits;
+    long long perf[NUM_PHASES][PERF_EVENTS]; // --perf, -1 when not counted
+} compile_stats;
+
+// What --constprop knows a frame slot holds at some point
+typedef enum
+{
+    VALUE_UNKNOWN, // no path has reached here yet
+    VALUE_CONST,   // value is the constant
+    VALUE_COPY,    // value is the slot it equals
+    VALUE_VARYING
+} value_kind;
+
+typedef struct
+{
+    value_kind kind;
+    int value;
+} slot_value;
+
+// A value --precompute saw written and the SYS 0 1 that wrote it
+typedef struct
+{
+    int value;
+    int pc;
+} eval_write;
+
 // Global variables
 symbol symbol_table[MAX_SYMBOL_TABLE_SIZE];
 instruction code[MAX_CODE_LENGTH];
 int symbol_table_index = 0;
 int code_index = 0;
+loop_info loops[MAX_CODE_LENGTH];
+int loop_count = 0;
+int inc_index = 0; // the INC that sizes the main frame
+int case_slot = 0;  // frame slot holding a case selector, 0 until needed
 int current_token;
 char current_identifier[MAX_LEXEME_LEN];
 int current_number;
 FILE *token_file;
 
+// Interned identifiers (tokens from lex --intern): names[id] and the
+// symbol each id is declared as, so lookups skip the table scan
+int interned_names = 0;
+int current_name_id = -1;
+char (*names)[12] = NULL;
+int *name_symbols = NULL;
+int name_count = 0, name_capacity = 0;
+
+// Scanner thread feeding the parser through a ring (--pipeline, builds
+// with -DPL0_PIPELINE that link lex.c in)
+const char *pipeline_path = NULL;
+#ifdef PL0_PIPELINE
+pipe_ring token_ring;
+#endif
+
+// Source positions (-g): tokens.lines runs in step with tokens.txt
+int debug_info = 0;
+FILE *lines_file;
+int token_line = 0, token_column = 0;
+
+// Compilation cache (disabled unless --cache is given, see cache.h)
+char cache_options[CACHE_OPTIONS_LEN] = "";
+cache_config cache = {NULL, CACHE_DEFAULT_SIZE, CACHE_VERSION, "parsercodegen.stats", cache_options,
+                      {MAX_SYMBOL_TABLE_SIZE, MAX_CODE_LENGTH}};
+
+// Optimization flags (all off by default so the listing matches the spec)
+int opt_dce = 0;
+int opt_licm = 0;
+int opt_simplify = 0;
+int opt_constprop = 0;
+int opt_dse = 0;
+int opt_precompute = 0;
+const char *profile_path = NULL; // --profile-use
+
+// Parse with explicit heap stacks instead of recursion (--iterative)
+int iterative_parser = 0;
+
+// Statistics (--stats prints text, --stats=json one JSON object, to stderr)
+#define STATS_TEXT 1
+#define STATS_JSON 2
+int stats_format = 0;
+compile_stats stats;
+
+// Hardware counters (--perf): sampled around the coarse phases only, as
+// reading them per token would cost more than the work being measured
+int perf_mode = 0;
+perf_counters perf;
+long long perf_start[PERF_EVENTS];
+
 // Function prototypes
 void error(const char *msg);
 void get_next_token();
+void read_token();
 void emit(int op, int l, int m);
+void emit_at(int op, int l, int m, int line, int column);
 int symbol_table_check(const char *name);
+void define_name(const char *name);
+void check_line_rows();
+#ifdef PL0_PIPELINE
+void read_pipe_token();
+void lexPipeline(FILE *source, pipe_ring *ring); // lex.c
+void *scanner_thread(void *source);
+#endif
+const char *current_name();
+int lookup_identifier();
 void program();
 void block();
 void const_declaration();
 int var_declaration();
 void statement();
+void case_statement(int line, int column);
+void case_begin(case_info *c, int line, int column);
+void case_labels(case_info *c);
+int case_arm_end(case_info *c);
+int compare_case_labels(const void *a, const void *b);
+void case_jump(case_info *c, int op, int target);
+void case_search(case_info *c, int lo, int hi);
+void case_end(case_info *c);
 
 // Added prototypes to avoid implicit declaration warnings
 void condition();
@@ -125,24 +435,228 @@ void expression();
 
 void term();
 void factor();
-void print_assembly();
+
+// Iterative parser (same code and diagnostics, no C recursion)
+void *grow_stack(void *stack, int *capacity, size_t size);
+void statement_iterative();
+void expression_iterative();
+void print_assembly(FILE *out);
 // show the source the lexer ran on
 void write_elf_file();
+void write_line_table();
+
+// Optimization passes over code[]
+int is_jump(int op);
+int is_binary_opr(int subop);
+int power_of_two(int value);
+void compact_code(const char *keep);
+int shift_right(int a, int k);
+int fold_binary(int a, int b, int subop, int *result);
+int fold_constants();
+int remove_unreachable();
+int remove_jumps_to_next();
+void eliminate_dead_code(FILE *out);
+void remap_loops(const int *map, int old_length);
+int hoist_loop(int li);
+void hoist_loop_invariants(FILE *out);
+int same_code(int x, int y, int len);
+int simplify_expressions(int *shifts);
+void simplify_algebra(FILE *out);
+int frame_is_local();
+int removable_value(int end, int block_start);
+void live_after(int end, const int *block_of, const uint64_t *live_in, int words, uint64_t *live);
+int remove_dead_stores(int *stores);
+void compact_frame();
+void eliminate_dead_stores(FILE *out);
+int meet_values(slot_value *into, const slot_value *from, int frame);
+void transfer_store(slot_value *state, int i, int frame, int block_start);
+int rewrite_known_loads(int *constants, int *copies);
+void propagate_constants(FILE *out);
+const char *evaluate_program(eval_write **writes, int *num_writes, int *halt_pc, long long *steps);
+void precompute_program(FILE *out);
+
+// Profile-guided layout (--profile-use)
+uint64_t code_checksum();
+int compare_profile_rows(const void *a, const void *b);
+profile_match load_profile(const char *path, long long *total, int *matched);
+int negate_relop(int subop);
+void relocate_code(instruction *new_code, int new_length, const int *map, const char *fixed);
+int invert_loop(int li);
+int move_cold_branch(int j);
+void apply_profile(FILE *out);
+
+// Statistics
+double stats_clock();
+void print_stats(FILE *out, const char *cache_result);
+void perf_begin();
+void perf_end(phase_id phase);
+void print_perf(FILE *out, long num_tokens);
 
 // Opcode names for display
 const char *op_names[] = {
-    "", "LIT", "OPR", "LOD", "STO", "CAL", "INC", "JMP", "JPC", "SYS"};
+    "", "LIT", "OPR", "LOD", "STO", "CAL", "INC", "JMP", "JPC", "SYS", "JTB"};
+
+// Names for --stats output
+const char *phase_names[] = {
+    "cache", "read", "parse", "emit", "optimize", "print_assembly", "write_elf_file"};
+const char *token_names[] = {
+    "", "skipsym", "identsym", "numbersym", "plussym", "minussym", "multsym",
+    "slashsym", "eqsym", "neqsym", "lessym", "leqsym", "gtrsym", "geqsym",
+    "lparentsym", "rparentsym", "commasym", "semicolonsym", "periodsym",
+    "becomessym", "beginsym", "endsym", "ifsym", "fisym", "thensym", "whilesym",
+    "dosym", "callsym", "constsym", "varsym", "procsym", "writesym", "readsym",
+    "elsesym", "evensym", "casesym", "ofsym"};
 
 // Main function
-int main()
+int main(int argc, char *argv[])
 {
-    token_file = fopen("tokens.txt", "r");
-    if (!token_file)
+    for (int i = 1; i < argc; i++)
     {
-        fprintf(stderr, "Error: Cannot open tokens.txt\n");
-        return 1;
+        if (strcmp(argv[i], "--cache") == 0 && i + 1 < argc)
+            cache.dir = argv[++i];
+        else if (strcmp(argv[i], "--cache-size") == 0 && i + 1 < argc)
+            cache.max_size = atol(argv[++i]);
+        else if (strcmp(argv[i], "--stats") == 0)
+            stats_format = STATS_TEXT;
+        else if (strcmp(argv[i], "--stats=json") == 0)
+            stats_format = STATS_JSON;
+        else if (strcmp(argv[i], "--perf") == 0)
+            perf_mode = 1;
+        else if (strcmp(argv[i], "--iterative") == 0)
+            iterative_parser = 1; // same output, so not part of the cache key
+#ifdef PL0_PIPELINE
+        else if (strcmp(argv[i], "--pipeline") == 0 && i + 1 < argc)
+            pipeline_path = argv[++i]; // no tokens.txt, so never cached
+#endif
+        else if (strcmp(argv[i], "-g") == 0)
+            debug_info = 1;
+        else if (strcmp(argv[i], "--dce") == 0)
+            opt_dce = 1;
+        else if (strcmp(argv[i], "--licm") == 0)
+            opt_licm = 1;
+        else if (strcmp(argv[i], "--simplify") == 0)
+            opt_simplify = 1;
+        else if (strcmp(argv[i], "--constprop") == 0)
+            opt_constprop = 1;
+        else if (strcmp(argv[i], "--dse") == 0)
+            opt_dse = 1;
+        else if (strcmp(argv[i], "--profile-use") == 0 && i + 1 < argc)
+            profile_path = argv[++i]; // its contents are hashed as an input
+        else if (strcmp(argv[i], "--precompute") == 0)
+            opt_precompute = 1;
+        else
+        {
+            printf("Usage: ./parsercodegen [-g] [--cache <dir>] [--cache-size <bytes>] [--simplify] [--constprop] [--dce] [--licm] [--dse] [--profile-use <file>] [--precompute] [--iterative]" PIPELINE_USAGE " [--stats[=json]] [--perf]\n");
+            return 1;
+        }
+    }
+
+    // Options that change the output are part of the cache key. They are
+    // added once each in a fixed order, after parsing, so the key does not
+    // depend on how they were spelled and repeating them cannot overflow
+    // cache_options
+    if (debug_info)
+        strcat(cache_options, " -g");
+    if (opt_simplify)
+        strcat(cache_options, " --simplify");
+    if (opt_constprop)
+        strcat(cache_options, " --constprop");
+    if (opt_dce)
+        strcat(cache_options, " --dce");
+    if (opt_licm)
+        strcat(cache_options, " --licm");
+    if (opt_dse)
+        strcat(cache_options, " --dse");
+    if (profile_path != NULL)
+        strcat(cache_options, " --profile-use");
+    if (opt_precompute)
+        strcat(cache_options, " --precompute");
+
+    // --perf reports through --stats, as text unless json was asked for
+    if (perf_mode)
+    {
+        if (!stats_format)
+            stats_format = STATS_TEXT;
+        for (int p = 0; p < NUM_PHASES; p++)
+            for (int e = 0; e < PERF_EVENTS; e++)
+                stats.perf[p][e] = -1;
+        perf_open(&perf, 0);
+    }
+
+    // An elf.lines left by an earlier -g build would be paired with this
+    // elf.txt by vm
+    if (!debug_info)
+        remove("elf.lines");
+
+    double start = stats_clock();
+    perf_begin();
+
+    // On a cache hit the listing and output files are replayed without parsing
+    const char *inputs[] = {"tokens.txt", "tokens.lines", NULL};
+    const char *artifacts[] = {"elf.txt", "elf.lines"};
+    int num_files = debug_info ? 2 : 1;
+    int num_inputs = num_files;
+    if (profile_path != NULL)
+        inputs[num_inputs++] = profile_path;
+    uint64_t key = 0;
+    if (cache.dir != NULL && pipeline_path == NULL)
+    {
+        key = cache_key(&cache, inputs, num_inputs);
+        int hit = key != 0 && cache_lookup(&cache, key, artifacts, num_files);
+        stats.seconds[PHASE_CACHE] = stats_clock() - start;
+        perf_end(PHASE_CACHE);
+        if (hit)
+        {
+            if (stats_format)
+                print_stats(stderr, "hit");
+            return 0;
+        }
+    }
+
+#ifdef PL0_PIPELINE
+    pthread_t scanner;
+    if (pipeline_path != NULL)
+    {
+        FILE *source = fopen(pipeline_path, "r");
+        if (source == NULL)
+        {
+            perror("Error opening file");
+            return 1;
+        }
+        pipe_init(&token_ring);
+        if (pthread_create(&scanner, NULL, scanner_thread, source) != 0)
+        {
+            fprintf(stderr, "Error: Cannot start scanner thread\n");
+            return 1;
+        }
+    }
+#endif
+
+    if (pipeline_path == NULL)
+    {
+        token_file = fopen("tokens.txt", "r");
+        if (!token_file)
+        {
+            fprintf(stderr, "Error: Cannot open tokens.txt\n");
+            return 1;
+        }
     }
 
+    if (debug_info && pipeline_path == NULL)
+    {
+        lines_file = fopen("tokens.lines", "r");
+        if (!lines_file)
+        {
+            fprintf(stderr, "Error: Cannot open tokens.lines (run lex with -g)\n");
+            return 1;
+        }
+    }
+
+    // Reading and emitting happen inside the parse; both are timed
+    // separately, but --perf counts them as part of it
+    double phase_start = stats_clock();
+    perf_begin();
+
     // Get first token
     get_next_token();
 
@@ -157,14 +671,83 @@ int main()
 
     // Parse program
     program();
+    if (lines_file)
+        check_line_rows();
 
-    fclose(token_file);
+    if (token_file)
+        fclose(token_file);
+    if (lines_file)
+        fclose(lines_file);
+
+#ifdef PL0_PIPELINE
+    // The parser stops at the period; let the scanner drop the rest
+    if (pipeline_path != NULL)
+    {
+        pipe_close(&token_ring);
+        pthread_join(scanner, NULL);
+    }
+#endif
+
+    stats.seconds[PHASE_PARSE] = stats_clock() - phase_start - stats.seconds[PHASE_READ] - stats.seconds[PHASE_EMIT];
+    perf_end(PHASE_PARSE);
+
+    // Capture the listing so a miss can be stored alongside elf.txt
+    FILE *listing = NULL;
+    if (key != 0)
+        listing = tmpfile();
+
+    FILE *out = listing != NULL ? listing : stdout;
+
+    phase_start = stats_clock();
+    perf_begin();
+    if (opt_simplify)
+        simplify_algebra(out);
+    if (opt_constprop)
+        propagate_constants(out);
+    if (opt_dce)
+        eliminate_dead_code(out);
+    if (opt_licm)
+        hoist_loop_invariants(out);
+    if (opt_dse)
+        eliminate_dead_stores(out);
+    if (profile_path != NULL)
+        apply_profile(out);
+    if (opt_precompute)
+        precompute_program(out);
+    stats.seconds[PHASE_OPTIMIZE] = stats_clock() - phase_start;
+    perf_end(PHASE_OPTIMIZE);
 
     // Print assembly to terminal
-    print_assembly();
+    phase_start = stats_clock();
+    perf_begin();
+    print_assembly(out);
+    stats.seconds[PHASE_PRINT_ASSEMBLY] = stats_clock() - phase_start;
+    perf_end(PHASE_PRINT_ASSEMBLY);
 
     // Write to elf.txt
+    phase_start = stats_clock();
+    perf_begin();
     write_elf_file();
+    if (debug_info)
+        write_line_table();
+    stats.seconds[PHASE_WRITE_ELF_FILE] = stats_clock() - phase_start;
+    perf_end(PHASE_WRITE_ELF_FILE);
+
+    if (listing != NULL)
+    {
+        phase_start = stats_clock();
+        perf_begin();
+        cache_store(&cache, key, listing, artifacts, num_files);
+        stats.seconds[PHASE_CACHE] += stats_clock() - phase_start;
+        perf_end(PHASE_CACHE);
+
+        rewind(listing);
+        copy_bytes(listing, stdout, -1);
+        fclose(listing);
+    }
+
+    if (stats_format)
+        print_stats(stderr, cache.dir != NULL ? "miss" : "off");
 
     return 0;
 }
@@ -187,14 +770,53 @@ void error(const char *msg)
 // Get next token from file
 void get_next_token()
 {
+    double start = stats_clock();
+    read_token();
+    stats.seconds[PHASE_READ] += stats_clock() - start;
+
+    if (current_token >= skipsym && current_token <= ofsym)
+        stats.tokens[current_token]++;
+}
+
+// Scan the next token code (and lexeme) from tokens.txt
+void read_token()
+{
+#ifdef PL0_PIPELINE
+    if (pipeline_path != NULL)
+    {
+        read_pipe_token();
+        return;
+    }
+#endif
+
     int t;
     // Read the next token code; loop until we return or hit EOF
     while (fscanf(token_file, "%d", &t) == 1)
     {
         current_token = t;
 
-        // If identifier, read its lexeme
-        if (current_token == identsym)
+        // lex --intern defines each name once ("0 <name>", id = order of
+        // definition) and then writes identifiers as "2 <id>"
+        if (current_token == 0)
+        {
+            char name[MAX_LEXEME_LEN];
+            if (fscanf(token_file, "%255s", name) != 1 || strlen(name) >= sizeof names[0])
+                error("Expected identifier name");
+            define_name(name);
+            continue;
+        }
+
+        if (lines_file && fscanf(lines_file, "%d %d", &token_line, &token_column) != 2)
+            error("tokens.lines does not match tokens.txt (run lex with -g)");
+
+        // If identifier, read its lexeme (or interned id)
+        if (current_token == identsym && interned_names)
+        {
+            if (fscanf(token_file, "%d", &current_name_id) != 1 || current_name_id < 0 ||
+                current_name_id >= name_count)
+                error("Expected identifier name");
+        }
+        else if (current_token == identsym)
         {
             if (fscanf(token_file, "%s", current_identifier) != 1)
                 error("Expected identifier name");
@@ -218,9 +840,37 @@ void get_next_token()
     current_token = -1;
 }
 
-// Emit instruction
+// -g: tokens.lines has one row per token of tokens.txt. The parse stops
+// at the period, so the rows of any tokens after it are counted off here;
+// a row left over means tokens.lines came from another lex run
+void check_line_rows()
+{
+    int t, line, column;
+    char word[MAX_LEXEME_LEN];
+    while (fscanf(token_file, "%d", &t) == 1)
+    {
+        // A name definition ("0 <name>") has no row; identifiers and numbers
+        // carry a lexeme or id
+        if ((t == 0 || t == identsym || t == numbersym) && fscanf(token_file, "%255s", word) != 1)
+            break;
+        if (t != 0 && fscanf(lines_file, "%d %d", &line, &column) != 2)
+            error("tokens.lines does not match tokens.txt (run lex with -g)");
+    }
+    if (fscanf(lines_file, "%d %d", &line, &column) == 2)
+        error("tokens.lines does not match tokens.txt (run lex with -g)");
+}
+
+// Emit instruction, attributed to the current token
 void emit(int op, int l, int m)
 {
+    emit_at(op, l, m, token_line, token_column);
+}
+
+// Emit instruction attributed to an earlier token (e.g. the operator of
+// an OPR emitted after its right operand)
+void emit_at(int op, int l, int m, int line, int column)
+{
+    double start = stats_clock();
     if (code_index >= MAX_CODE_LENGTH)
     {
         error("Code segment overflow");
@@ -228,19 +878,103 @@ void emit(int op, int l, int m)
     code[code_index].op = op;
     code[code_index].l = l;
     code[code_index].m = m;
+    code[code_index].line = line;
+    code[code_index].column = column;
     code_index++;
+    stats.emits++;
+    stats.seconds[PHASE_EMIT] += stats_clock() - start;
+}
+
+#ifdef PL0_PIPELINE
+// Take the next token from the scanner thread (--pipeline). Names arrive
+// interned, as with lex --intern; end of input is type -1
+void read_pipe_token()
+{
+    pipe_token token;
+    pipe_pop(&token_ring, &token);
+    while (token.type == 0)
+    {
+        define_name(token.name);
+        pipe_pop(&token_ring, &token);
+    }
+
+    current_token = token.type;
+    if (debug_info)
+    {
+        token_line = token.line;
+        token_column = token.column;
+    }
+
+    if (current_token == identsym)
+        current_name_id = token.value;
+    else if (current_token == numbersym)
+        current_number = token.value;
+
+    // A scanning error reaches the parser at the same point as from tokens.txt
+    if (current_token == skipsym)
+        error("Scanning error detected by lexer (skipsym present)");
+}
+
+void *scanner_thread(void *source)
+{
+    lexPipeline(source, &token_ring);
+    fclose(source);
+    return NULL;
+}
+#endif
+
+// Record the next interned name; its symbol is filled in at declaration
+void define_name(const char *name)
+{
+    if (name_count == name_capacity)
+    {
+        name_capacity = name_capacity == 0 ? 256 : 2 * name_capacity;
+        names = realloc(names, name_capacity * sizeof *names);
+        name_symbols = realloc(name_symbols, name_capacity * sizeof *name_symbols);
+        if (names == NULL || name_symbols == NULL)
+            error("Out of memory");
+    }
+
+    strcpy(names[name_count], name);
+    name_symbols[name_count] = -1;
+    name_count++;
+    interned_names = 1;
+}
+
+// Name of the current identifier token
+const char *current_name()
+{
+    return interned_names ? names[current_name_id] : current_identifier;
+}
+
+// Symbol of the current identifier token, or -1: a direct index when the
+// tokens are interned, otherwise a scan of the symbol table
+int lookup_identifier()
+{
+    if (!interned_names)
+        return symbol_table_check(current_identifier);
+
+    stats.symbol_checks++;
+    stats.symbol_probes++;
+    int i = name_symbols[current_name_id];
+    if (i >= 0 && symbol_table[i].mark == 0)
+        return i;
+    return -1;
 }
 
 // Symbol table lookup
 int symbol_table_check(const char *name)
 {
+    stats.symbol_checks++;
     for (int i = 0; i < symbol_table_index; i++)
     {
         if (strcmp(symbol_table[i].name, name) == 0 && symbol_table[i].mark == 0)
         {
+            stats.symbol_probes += i + 1;
             return i;
         }
     }
+    stats.symbol_probes += symbol_table_index;
     return -1;
 }
 
@@ -268,9 +1002,13 @@ void block()
     const_declaration();
     int num_vars = var_declaration();
 
+    inc_index = code_index;
     emit(6, 0, 3 + num_vars); // INC
 
-    statement();
+    if (iterative_parser)
+        statement_iterative();
+    else
+        statement();
 
     // Instead of popping, mark them out-of-scope
     for (int i = saved_table_index; i < symbol_table_index; i++)
@@ -295,9 +1033,10 @@ void const_declaration()
             }
 
             char saved_name[12];
-            strcpy(saved_name, current_identifier);
+            strcpy(saved_name, current_name());
+            int saved_id = current_name_id;
 
-            if (symbol_table_check(saved_name) != -1)
+            if (lookup_identifier() != -1)
             {
                 error("symbol name has already been declared");
             }
@@ -323,6 +1062,8 @@ void const_declaration()
             symbol_table[symbol_table_index].level = 0;
             symbol_table[symbol_table_index].addr = 0;
             symbol_table[symbol_table_index].mark = 0;
+            if (saved_id >= 0)
+                name_symbols[saved_id] = symbol_table_index;
             symbol_table_index++;
 
             get_next_token();
@@ -355,18 +1096,20 @@ int var_declaration()
                 error("const, var, and read keywords must be followed by identifier");
             }
 
-            if (symbol_table_check(current_identifier) != -1)
+            if (lookup_identifier() != -1)
             {
                 error("symbol name has already been declared");
             }
 
             // Add to symbol table
             symbol_table[symbol_table_index].kind = 2;
-            strcpy(symbol_table[symbol_table_index].name, current_identifier);
+            strcpy(symbol_table[symbol_table_index].name, current_name());
             symbol_table[symbol_table_index].val = 0;
             symbol_table[symbol_table_index].level = 0;
             symbol_table[symbol_table_index].addr = num_vars + 2;
             symbol_table[symbol_table_index].mark = 0;
+            if (current_name_id >= 0)
+                name_symbols[current_name_id] = symbol_table_index;
             symbol_table_index++;
 
             get_next_token();
@@ -387,12 +1130,11 @@ int var_declaration()
 // STATEMENT
 void statement()
 {
+    int line = token_line, column = token_column;
+
     if (current_token == identsym)
     {
-        char saved_name[12];
-        strcpy(saved_name, current_identifier);
-
-        int sym_idx = symbol_table_check(saved_name);
+        int sym_idx = lookup_identifier();
         if (sym_idx == -1)
         {
             // changed to exact required message
@@ -414,7 +1156,7 @@ void statement()
         get_next_token();
         expression();
 
-        emit(4, 0, symbol_table[sym_idx].addr); // STO
+        emit_at(4, 0, symbol_table[sym_idx].addr, line, column); // STO
         return;
     }
 
@@ -441,7 +1183,7 @@ void statement()
         condition();
 
         int jpc_idx = code_index;
-        emit(8, 0, 0); // JPC - will be patched
+        emit_at(8, 0, 0, line, column); // JPC - will be patched
 
         if (current_token != thensym)
         {
@@ -477,12 +1219,17 @@ void statement()
         get_next_token();
 
         int jpc_idx = code_index;
-        emit(8, 0, 0); // JPC - will be patched
+        emit_at(8, 0, 0, line, column); // JPC - will be patched
 
         statement();
 
-        emit(7, 0, loop_idx); // JMP back to condition
+        emit_at(7, 0, loop_idx, line, column); // JMP back to condition
         code[jpc_idx].m = code_index;
+
+        loops[loop_count].head = loop_idx;
+        loops[loop_count].jpc = jpc_idx;
+        loops[loop_count].back = code_index - 1;
+        loop_count++;
         return;
     }
 
@@ -495,7 +1242,7 @@ void statement()
             error("const, var, and read keywords must be followed by identifier");
         }
 
-        int sym_idx = symbol_table_check(current_identifier);
+        int sym_idx = lookup_identifier();
         if (sym_idx == -1)
         {
             // changed to exact required message
@@ -509,8 +1256,8 @@ void statement()
 
         get_next_token();
 
-        emit(9, 0, 2);                          // SYS 0 2 (READ)
-        emit(4, 0, symbol_table[sym_idx].addr); // STO
+        emit_at(9, 0, 2, line, column);                          // SYS 0 2 (READ)
+        emit_at(4, 0, symbol_table[sym_idx].addr, line, column); // STO
         return;
     }
 
@@ -518,9 +1265,264 @@ void statement()
     {
         get_next_token();
         expression();
-        emit(9, 0, 1); // SYS 0 1 (WRITE)
+        emit_at(9, 0, 1, line, column); // SYS 0 1 (WRITE)
+        return;
+    }
+
+    if (current_token == casesym)
+    {
+        case_statement(line, column);
+        return;
+    }
+}
+
+// CASE ::= "case" EXPRESSION "of" ARM {";" ARM} [";"] ["else" STATEMENT] "end"
+// ARM ::= LABEL {"," LABEL} "then" STATEMENT, LABEL ::= ["-"] number | const
+// The arms are emitted as they are read, each ending in a JMP past the
+// case; the dispatch can only follow once every label is known, and is
+// then rotated in front of them. case_begin reads up to the first arm's
+// statement
+void case_statement(int line, int column)
+{
+    // On the heap, as in statement_iterative: a local would grow the frame
+    // of every statement() level once inlined, case or not
+    case_info *c = malloc(sizeof *c);
+    if (c == NULL)
+        error("Out of memory");
+    case_begin(c, line, column);
+    do
+    {
+        statement();
+    } while (case_arm_end(c));
+    case_end(c);
+    free(c);
+}
+
+void case_begin(case_info *c, int line, int column)
+{
+    *c = (case_info){line, column, 0, 0, -1, NULL, 0, 0, NULL, 0, 0};
+
+    get_next_token();
+    expression();
+
+    if (current_token != ofsym)
+    {
+        error("case must be followed by of");
+    }
+
+    get_next_token();
+    c->arms = code_index;
+    c->first_loop = loop_count;
+    case_labels(c);
+}
+
+// LABEL {"," LABEL} "then"; the labels select the arm starting here
+void case_labels(case_info *c)
+{
+    for (;;)
+    {
+        int value, negative = 0;
+        if (current_token == minussym)
+        {
+            negative = 1;
+            get_next_token();
+        }
+
+        int sym_idx = current_token == identsym ? lookup_identifier() : -1;
+        if (current_token == numbersym)
+            value = current_number;
+        else if (sym_idx != -1 && symbol_table[sym_idx].kind == 1)
+            value = symbol_table[sym_idx].val;
+        else
+        {
+            error("case labels must be numbers or constants");
+        }
+
+        if (c->num_labels == c->label_capacity)
+            c->labels = grow_stack(c->labels, &c->label_capacity, sizeof *c->labels);
+        c->labels[c->num_labels++] = (case_label){negative ? -value : value, code_index};
+        get_next_token();
+
+        if (current_token != commasym)
+            break;
+        get_next_token();
+    }
+
+    if (current_token != thensym)
+    {
+        error("case labels must be followed by then");
+    }
+
+    get_next_token();
+}
+
+// After an arm's statement: leave the case, then go on to the next arm
+// (1) or see the "end" (0)
+int case_arm_end(case_info *c)
+{
+    if (c->num_exits == c->exit_capacity)
+        c->exits = grow_stack(c->exits, &c->exit_capacity, sizeof *c->exits);
+    c->exits[c->num_exits++] = code_index;
+    emit_at(7, 0, 0, c->line, c->column); // JMP past the dispatch - will be patched
+
+    if (c->default_arm < 0)
+    {
+        if (current_token == semicolonsym)
+        {
+            get_next_token();
+            if (current_token != elsesym && current_token != endsym)
+            {
+                case_labels(c);
+                return 1;
+            }
+        }
+
+        if (current_token == elsesym)
+        {
+            get_next_token();
+            c->default_arm = code_index;
+            return 1;
+        }
+    }
+
+    if (current_token != endsym)
+    {
+        error("case must be followed by end");
+    }
+
+    get_next_token();
+    return 0;
+}
+
+int compare_case_labels(const void *a, const void *b)
+{
+    int x = ((const case_label *)a)->value, y = ((const case_label *)b)->value;
+    return (x > y) - (x < y);
+}
+
+// JMP/JPC to target, or past the case when target is -1 (no else)
+void case_jump(case_info *c, int op, int target)
+{
+    if (target < 0)
+    {
+        if (c->num_exits == c->exit_capacity)
+            c->exits = grow_stack(c->exits, &c->exit_capacity, sizeof *c->exits);
+        c->exits[c->num_exits++] = code_index;
+    }
+    emit_at(op, 0, target < 0 ? 0 : target, c->line, c->column);
+}
+
+// Binary search of labels[lo..hi] (sorted) for the selector in case_slot:
+// halve on LSS until at most three labels are left, then test each one
+void case_search(case_info *c, int lo, int hi)
+{
+    if (hi - lo < 3)
+    {
+        for (int k = lo; k <= hi; k++)
+        {
+            emit_at(3, 0, case_slot, c->line, c->column);             // LOD selector
+            emit_at(1, 0, c->labels[k].value, c->line, c->column);    // LIT
+            emit_at(2, 0, 6, c->line, c->column);                     // OPR 0 6 (NEQ)
+            emit_at(8, 0, c->labels[k].arm, c->line, c->column);      // JPC to the arm when equal
+        }
+        case_jump(c, 7, c->default_arm);
         return;
     }
+
+    int mid = (lo + hi + 1) / 2;
+    emit_at(3, 0, case_slot, c->line, c->column);
+    emit_at(1, 0, c->labels[mid].value, c->line, c->column);
+    emit_at(2, 0, 7, c->line, c->column); // OPR 0 7 (LSS)
+    int jpc_idx = code_index;
+    emit_at(8, 0, 0, c->line, c->column); // JPC to the upper half - will be patched
+    case_search(c, lo, mid - 1);
+    code[jpc_idx].m = code_index;
+    case_search(c, mid, hi);
+}
+
+// Emit the dispatch for the selector left on the stack. Labels covering
+// at least half of their range get a jump table: JTB 0 n (vm.c opcode 10)
+// pops the index and continues at the target of the index-th of the n + 1
+// JMPs after it, the last one for an index outside 0..n-1. Sparser labels
+// keep the selector in case_slot for a binary search
+void case_end(case_info *c)
+{
+    int dispatch = code_index;
+    qsort(c->labels, (size_t)c->num_labels, sizeof *c->labels, compare_case_labels);
+    for (int k = 1; k < c->num_labels; k++)
+    {
+        if (c->labels[k].value == c->labels[k - 1].value)
+        {
+            error("duplicate case label");
+        }
+    }
+
+    int n = c->num_labels;
+    long long low = n > 0 ? c->labels[0].value : 0;
+    long long high = n > 0 ? c->labels[n - 1].value : -1;
+
+    // A table from 0 saves subtracting the lowest label when it stays dense
+    long long base = low >= 0 && high < 2LL * n ? 0 : low;
+    if (high - base + 1 <= 2LL * n)
+    {
+        if (base != 0)
+        {
+            emit_at(1, 0, (int)base, c->line, c->column); // LIT
+            emit_at(2, 0, 2, c->line, c->column);         // OPR 0 2 (SUB)
+        }
+        emit_at(10, 0, (int)(high - base + 1), c->line, c->column); // JTB
+        for (long long value = base, k = 0; value <= high; value++)
+        {
+            if (c->labels[k].value == value)
+                case_jump(c, 7, c->labels[k++].arm);
+            else
+                case_jump(c, 7, c->default_arm);
+        }
+        case_jump(c, 7, c->default_arm);
+    }
+    else
+    {
+        // One slot serves every case: a selector is dead once its
+        // dispatch has jumped to an arm
+        if (case_slot == 0)
+            case_slot = code[inc_index].m++;
+        emit_at(4, 0, case_slot, c->line, c->column); // STO selector
+        case_search(c, 0, n - 1);
+    }
+
+    // Rotate [arms, dispatch) [dispatch, end) into dispatch, arms: every
+    // jump of the case then goes forward, and none is needed from the
+    // selector to the dispatch
+    int start = c->arms, end = code_index;
+    int arms_shift = end - dispatch, dispatch_shift = dispatch - start;
+    instruction *rotated = malloc((size_t)(end - start) * sizeof *rotated);
+    if (rotated == NULL)
+        error("Out of memory");
+    memcpy(rotated, &code[dispatch], (size_t)arms_shift * sizeof *rotated);
+    memcpy(rotated + arms_shift, &code[start], (size_t)dispatch_shift * sizeof *rotated);
+    memcpy(&code[start], rotated, (size_t)(end - start) * sizeof *rotated);
+    free(rotated);
+
+    for (int i = start; i < end; i++)
+    {
+        int m = code[i].m;
+        if (is_jump(code[i].op) && m >= start && m < end)
+            code[i].m = m < dispatch ? m + arms_shift : m - dispatch_shift;
+    }
+    for (int i = c->first_loop; i < loop_count; i++)
+    {
+        loops[i].head += arms_shift;
+        loops[i].back += arms_shift;
+        if (loops[i].jpc >= 0)
+            loops[i].jpc += arms_shift;
+    }
+    for (int k = 0; k < c->num_exits; k++)
+    {
+        int i = c->exits[k] < dispatch ? c->exits[k] + arms_shift : c->exits[k] - dispatch_shift;
+        code[i].m = end;
+    }
+    free(c->labels);
+    free(c->exits);
 }
 
 // TODO: FOR TEAMMATE TO IMPLEMENT
@@ -529,9 +1531,10 @@ void condition()
 {
     if (current_token == evensym)
     {
+        int line = token_line, column = token_column;
         get_next_token();
         expression();
-        emit(2, 0, 11); // OPR 0 11  (EVEN), not the ODD+compare trick
+        emit_at(2, 0, 11, line, column); // OPR 0 11  (EVEN), not the ODD+compare trick
         return;
     }
 
@@ -553,31 +1556,39 @@ void condition()
     else
         error("condition must contain comparison operator");
 
-    get_next_token();  // consume rel-op
-    expression();      // right
-    emit(2, 0, subop); // OPR 0 subop
+    int line = token_line, column = token_column;
+    get_next_token();                  // consume rel-op
+    expression();                      // right
+    emit_at(2, 0, subop, line, column); // OPR 0 subop
 }
 
 // TODO: FOR TEAMMATE TO IMPLEMENT
 // EXPRESSION ::= TERM { ("+" | "-") TERM }
 void expression()
 {
+    if (iterative_parser)
+    {
+        expression_iterative();
+        return;
+    }
+
     // EXPRESSION ::= TERM { ("+" | "-") TERM }
     term();
 
     while (current_token == plussym || current_token == minussym)
     {
+        int line = token_line, column = token_column;
         if (current_token == plussym)
         {
             get_next_token();
             term();
-            emit(2, 0, 1); // OPR 0 1 (ADD)
+            emit_at(2, 0, 1, line, column); // OPR 0 1 (ADD)
         }
         else
         {
             get_next_token();
             term();
-            emit(2, 0, 2); // OPR 0 2 (SUB)
+            emit_at(2, 0, 2, line, column); // OPR 0 2 (SUB)
         }
     }
 }
@@ -589,17 +1600,18 @@ void term()
 
     while (current_token == multsym || current_token == slashsym)
     {
+        int line = token_line, column = token_column;
         if (current_token == multsym)
         {
             get_next_token();
             factor();
-            emit(2, 0, 3); // OPR 0 3 (MUL)
+            emit_at(2, 0, 3, line, column); // OPR 0 3 (MUL)
         }
         else
         {
             get_next_token();
             factor();
-            emit(2, 0, 4); // OPR 0 4 (DIV)
+            emit_at(2, 0, 4, line, column); // OPR 0 4 (DIV)
         }
     }
 }
@@ -609,7 +1621,7 @@ void factor()
 {
     if (current_token == identsym)
     {
-        int sym_idx = symbol_table_check(current_identifier);
+        int sym_idx = lookup_identifier();
         if (sym_idx == -1)
         {
             // changed to exact required message
@@ -652,27 +1664,2155 @@ void factor()
     }
 }
 
-// Print assembly code to terminal
-void print_assembly()
+// Double a heap stack when it is full (capacity 0 allocates it)
+void *grow_stack(void *stack, int *capacity, size_t size)
 {
-    printf("\nAssembly Code:\n");
-    printf("Line OP L M\n");
+    int grown = *capacity > 0 ? *capacity * 2 : 64;
+    void *moved = realloc(stack, (size_t)grown * size);
+    if (moved == NULL)
+        error("Out of memory");
+    *capacity = grown;
+    return moved;
+}
 
-    for (int i = 0; i < code_index; i++)
-    { // start at 0
-        int op = code[i].op, l = code[i].l, m = code[i].m;
-        // match elf.txt formatting: scale targets for CAL/JMP/JPC
-        if (op == 5 || op == 7 || op == 8)
-            m = m * 3;
-        printf("%d %s %d %d\n", i, op_names[op], l, m);
-    }
+// STATEMENT without recursion: begin/if/while push a frame and go on with
+// their first inner statement; each finished statement closes frames
+// (the code after statement() returns in the recursive version)
+void statement_iterative()
+{
+    statement_frame *frames = NULL;
+    int depth = 0, capacity = 0;
 
-    printf("Symbol Table:\n");
-    printf("Kind | Name | Value | Level | Address | Mark\n");
-    printf("---------------------------------------------------\n");
-    for (int i = 0; i < symbol_table_index; i++)
+    for (;;)
     {
-        printf("%d | %s | %d | %d | %d | %d\n",
+        int line = token_line, column = token_column;
+
+        if (current_token == beginsym)
+        {
+            if (depth == capacity)
+                frames = grow_stack(frames, &capacity, sizeof *frames);
+            frames[depth++] = (statement_frame){FRAME_BEGIN, line, column, 0, 0, NULL};
+            get_next_token();
+            continue;
+        }
+
+        if (current_token == ifsym)
+        {
+            get_next_token();
+            condition();
+
+            int jpc_idx = code_index;
+            emit_at(8, 0, 0, line, column); // JPC - will be patched
+
+            if (current_token != thensym)
+            {
+                error("if must be followed by then");
+            }
+
+            get_next_token();
+            if (depth == capacity)
+                frames = grow_stack(frames, &capacity, sizeof *frames);
+            frames[depth++] = (statement_frame){FRAME_IF, line, column, jpc_idx, 0, NULL};
+            continue;
+        }
+
+        if (current_token == whilesym)
+        {
+            get_next_token();
+            int loop_idx = code_index;
+
+            condition();
+
+            if (current_token != dosym)
+            {
+                error("while must be followed by do");
+            }
+
+            get_next_token();
+
+            int jpc_idx = code_index;
+            emit_at(8, 0, 0, line, column); // JPC - will be patched
+
+            if (depth == capacity)
+                frames = grow_stack(frames, &capacity, sizeof *frames);
+            frames[depth++] = (statement_frame){FRAME_WHILE, line, column, jpc_idx, loop_idx, NULL};
+            continue;
+        }
+
+        if (current_token == casesym)
+        {
+            case_info *c = malloc(sizeof *c);
+            if (c == NULL)
+                error("Out of memory");
+            case_begin(c, line, column);
+
+            if (depth == capacity)
+                frames = grow_stack(frames, &capacity, sizeof *frames);
+            frames[depth++] = (statement_frame){FRAME_CASE, line, column, 0, 0, c};
+            continue;
+        }
+
+        if (current_token == identsym)
+        {
+            int sym_idx = lookup_identifier();
+            if (sym_idx == -1)
+            {
+                error("undeclared identifier");
+            }
+
+            if (symbol_table[sym_idx].kind != 2)
+            {
+                error("only variable values may be altered");
+            }
+
+            get_next_token();
+
+            if (current_token != becomessym)
+            {
+                error("assignment statements must use :=");
+            }
+
+            get_next_token();
+            expression();
+
+            emit_at(4, 0, symbol_table[sym_idx].addr, line, column); // STO
+        }
+        else if (current_token == readsym)
+        {
+            get_next_token();
+
+            if (current_token != identsym)
+            {
+                error("const, var, and read keywords must be followed by identifier");
+            }
+
+            int sym_idx = lookup_identifier();
+            if (sym_idx == -1)
+            {
+                error("undeclared identifier");
+            }
+
+            if (symbol_table[sym_idx].kind != 2)
+            {
+                error("only variable values may be altered");
+            }
+
+            get_next_token();
+
+            emit_at(9, 0, 2, line, column);                          // SYS 0 2 (READ)
+            emit_at(4, 0, symbol_table[sym_idx].addr, line, column); // STO
+        }
+        else if (current_token == writesym)
+        {
+            get_next_token();
+            expression();
+            emit_at(9, 0, 1, line, column); // SYS 0 1 (WRITE)
+        }
+        // anything else is the empty statement
+
+        // A statement is complete: close frames until one wants another
+        int next_statement = 0;
+        while (depth > 0 && !next_statement)
+        {
+            statement_frame *top = &frames[depth - 1];
+            if (top->kind == FRAME_BEGIN)
+            {
+                if (current_token == semicolonsym)
+                {
+                    get_next_token();
+                    next_statement = 1;
+                    continue;
+                }
+
+                if (current_token != endsym)
+                {
+                    error("begin must be followed by end");
+                }
+
+                get_next_token();
+            }
+            else if (top->kind == FRAME_IF)
+            {
+                if (current_token != fisym)
+                {
+                    error("if must be followed by then");
+                }
+
+                get_next_token();
+
+                code[top->jpc].m = code_index;
+            }
+            else if (top->kind == FRAME_CASE)
+            {
+                if (case_arm_end(top->case_stmt))
+                {
+                    next_statement = 1;
+                    continue;
+                }
+
+                case_end(top->case_stmt);
+                free(top->case_stmt);
+            }
+            else
+            {
+                emit_at(7, 0, top->head, top->line, top->column); // JMP back to condition
+                code[top->jpc].m = code_index;
+
+                loops[loop_count].head = top->head;
+                loops[loop_count].jpc = top->jpc;
+                loops[loop_count].back = code_index - 1;
+                loop_count++;
+            }
+            depth--;
+        }
+
+        if (!next_statement)
+            break;
+    }
+
+    free(frames);
+}
+
+// EXPRESSION by shunting-yard: operands are emitted as they are read and
+// an operator waits on the stack until one of lower or equal precedence
+// (or the end of its parenthesis) arrives, which reproduces the left-
+// associative order of expression/term/factor
+void expression_iterative()
+{
+    pending_op *ops = NULL;
+    int depth = 0, capacity = 0;
+
+    for (;;)
+    {
+        // Operand: any number of "(" then an identifier or number
+        while (current_token == lparentsym)
+        {
+            if (depth == capacity)
+                ops = grow_stack(ops, &capacity, sizeof *ops);
+            ops[depth++] = (pending_op){0, token_line, token_column};
+            get_next_token();
+        }
+
+        if (current_token == identsym)
+        {
+            int sym_idx = lookup_identifier();
+            if (sym_idx == -1)
+            {
+                error("undeclared identifier");
+            }
+
+            if (symbol_table[sym_idx].kind == 1)
+                emit(1, 0, symbol_table[sym_idx].val); // LIT
+            else if (symbol_table[sym_idx].kind == 2)
+                emit(3, 0, symbol_table[sym_idx].addr); // LOD
+
+            get_next_token();
+        }
+        else if (current_token == numbersym)
+        {
+            emit(1, 0, current_number); // LIT
+            get_next_token();
+        }
+        else
+        {
+            error("arithmetic equations must contain operands, parentheses, numbers, or symbols");
+        }
+
+        // Operators, and the ")" closing any open parentheses
+        for (;;)
+        {
+            int subop = current_token == plussym    ? 1
+                        : current_token == minussym ? 2
+                        : current_token == multsym  ? 3
+                        : current_token == slashsym ? 4
+                                                    : 0;
+            if (subop != 0)
+            {
+                // ADD/SUB bind looser than MUL/DIV
+                int precedence = subop <= 2 ? 1 : 2;
+                while (depth > 0 && ops[depth - 1].subop != 0 &&
+                       (ops[depth - 1].subop <= 2 ? 1 : 2) >= precedence)
+                {
+                    depth--;
+                    emit_at(2, 0, ops[depth].subop, ops[depth].line, ops[depth].column);
+                }
+
+                if (depth == capacity)
+                    ops = grow_stack(ops, &capacity, sizeof *ops);
+                ops[depth++] = (pending_op){subop, token_line, token_column};
+                get_next_token();
+                break; // next operand
+            }
+
+            // End of the innermost open expression
+            while (depth > 0 && ops[depth - 1].subop != 0)
+            {
+                depth--;
+                emit_at(2, 0, ops[depth].subop, ops[depth].line, ops[depth].column);
+            }
+
+            if (depth == 0)
+            {
+                free(ops);
+                return;
+            }
+
+            if (current_token != rparentsym)
+            {
+                error("right parenthesis must follow left parenthesis");
+            }
+
+            depth--; // the "("
+            get_next_token();
+        }
+    }
+}
+
+// Jump-like instructions whose M is a code index
+int is_jump(int op)
+{
+    return op == 5 || op == 7 || op == 8;
+}
+
+// OPR subops that pop two operands and push one
+int is_binary_opr(int subop)
+{
+    return (subop >= 1 && subop <= 10) || subop == 12 || subop == 13;
+}
+
+// k when value is 2^k (k >= 1), otherwise 0
+int power_of_two(int value)
+{
+    if (value < 2 || (value & (value - 1)) != 0)
+        return 0;
+    int k = 0;
+    while (value > 1)
+    {
+        value >>= 1;
+        k++;
+    }
+    return k;
+}
+
+// Drop instructions with keep[i] == 0 and relocate jump targets; a target
+// that was removed now points at the next surviving instruction
+void compact_code(const char *keep)
+{
+    int *map = malloc((size_t)(code_index + 1) * sizeof *map);
+    if (map == NULL)
+        error("Out of memory");
+
+    int kept = 0;
+    for (int i = 0; i < code_index; i++)
+    {
+        map[i] = kept;
+        if (keep[i])
+            code[kept++] = code[i];
+    }
+    map[code_index] = kept;
+
+    for (int i = 0; i < kept; i++)
+    {
+        if (is_jump(code[i].op) && code[i].m >= 0 && code[i].m <= code_index)
+            code[i].m = map[code[i].m];
+    }
+
+    inc_index = map[inc_index];
+    int old_length = code_index;
+    code_index = kept;
+    remap_loops(map, old_length);
+    free(map);
+}
+
+// SHR: a / 2^k rounded toward zero, the way DIV rounds (k taken mod 32)
+int shift_right(int a, int k)
+{
+    k &= 31;
+    if (a < 0)
+        return (int)(0u - ((0u - (unsigned)a) >> k));
+    return a >> k;
+}
+
+// Evaluate OPR subop on two constants; 0 if it would trap at run time
+int fold_binary(int a, int b, int subop, int *result)
+{
+    switch (subop)
+    {
+    case 1:
+        *result = (int)((unsigned)a + (unsigned)b);
+        return 1;
+    case 2:
+        *result = (int)((unsigned)a - (unsigned)b);
+        return 1;
+    case 3:
+        *result = (int)((unsigned)a * (unsigned)b);
+        return 1;
+    case 4:
+        if (b == 0 || (a == INT_MIN && b == -1))
+            return 0;
+        *result = a / b;
+        return 1;
+    case 5:
+        *result = a == b;
+        return 1;
+    case 6:
+        *result = a != b;
+        return 1;
+    case 7:
+        *result = a < b;
+        return 1;
+    case 8:
+        *result = a <= b;
+        return 1;
+    case 9:
+        *result = a > b;
+        return 1;
+    case 10:
+        *result = a >= b;
+        return 1;
+    case 12:
+        *result = (int)((unsigned)a << (b & 31));
+        return 1;
+    case 13:
+        *result = shift_right(a, b);
+        return 1;
+    }
+    return 0;
+}
+
+// Fold LIT LIT OPR, LIT EVEN and LIT JPC while copying code[] onto itself.
+// Only the first instruction of a pattern may be a jump target.
+int fold_constants()
+{
+    int n = code_index;
+    char *target = calloc((size_t)n + 1, 1);
+    char *slot_target = calloc((size_t)n + 1, 1);
+    int *map = malloc((size_t)(n + 1) * sizeof *map);
+    if (target == NULL || slot_target == NULL || map == NULL)
+        error("Out of memory");
+
+    for (int i = 0; i < n; i++)
+    {
+        if (is_jump(code[i].op) && code[i].m >= 0 && code[i].m <= n)
+            target[code[i].m] = 1;
+    }
+
+    int out = 0, folded = 0;
+    for (int i = 0; i < n; i++)
+    {
+        map[i] = out;
+        slot_target[out] = target[i];
+        code[out++] = code[i];
+
+        instruction *top = &code[out - 1];
+        int value;
+
+        if (top->op == 2 && is_binary_opr(top->m) && out >= 3 &&
+            code[out - 2].op == 1 && code[out - 3].op == 1 &&
+            !slot_target[out - 1] && !slot_target[out - 2] &&
+            fold_binary(code[out - 3].m, code[out - 2].m, top->m, &value))
+        {
+            code[out - 3].m = value;
+            out -= 2;
+            folded += 2;
+        }
+        else if (top->op == 2 && top->m == 11 && out >= 2 &&
+                 code[out - 2].op == 1 && !slot_target[out - 1])
+        {
+            code[out - 2].m = code[out - 2].m % 2 == 0;
+            out -= 1;
+            folded += 1;
+        }
+        else if (top->op == 8 && out >= 2 && code[out - 2].op == 1 && !slot_target[out - 1])
+        {
+            if (code[out - 2].m != 0)
+            {
+                // Always true: the branch never fires
+                out -= 2;
+                folded += 2;
+            }
+            else
+            {
+                // Always false: the branch always fires
+                code[out - 2].op = 7;
+                code[out - 2].l = 0;
+                code[out - 2].m = top->m;
+                out -= 1;
+                folded += 1;
+            }
+        }
+    }
+    map[n] = out;
+
+    for (int i = 0; i < out; i++)
+    {
+        if (is_jump(code[i].op) && code[i].m >= 0 && code[i].m <= n)
+            code[i].m = map[code[i].m];
+    }
+    inc_index = map[inc_index];
+    code_index = out;
+    remap_loops(map, n);
+
+    free(target);
+    free(slot_target);
+    free(map);
+    return folded;
+}
+
+// Walk basic blocks from the entry and drop every block that is never reached
+int remove_unreachable()
+{
+    int n = code_index;
+    char *leader = calloc((size_t)n + 1, 1);
+    char *seen = calloc((size_t)n + 1, 1);
+    char *keep = calloc((size_t)n + 1, 1);
+    int *work = malloc((size_t)(n + 1) * sizeof *work);
+    if (leader == NULL || seen == NULL || keep == NULL || work == NULL)
+        error("Out of memory");
+
+    // Leaders: jump targets and whatever follows a jump or halt
+    for (int i = 0; i < n; i++)
+    {
+        int op = code[i].op;
+        if (is_jump(op) && code[i].m >= 0 && code[i].m < n)
+            leader[code[i].m] = 1;
+        if (op == 7 || op == 8 || op == 10 || (op == 9 && code[i].m == 3) || (op == 2 && code[i].m == 0))
+            leader[i + 1] = 1;
+    }
+
+    int top = 0;
+    work[top++] = 0;
+    seen[0] = 1;
+    while (top > 0)
+    {
+        int i = work[--top];
+        while (i < n)
+        {
+            int op = code[i].op, m = code[i].m;
+            keep[i] = 1;
+
+            // Successor blocks are queued once each
+            int succ[2], num_succ = 0, falls_through = 1;
+            if (op == 7)
+            {
+                succ[num_succ++] = m;
+                falls_through = 0;
+            }
+            else if (op == 8 || op == 5)
+                succ[num_succ++] = m;
+            else if ((op == 9 && m == 3) || (op == 2 && m == 0))
+                falls_through = 0;
+            else if (op == 10)
+            {
+                // The table after a JTB is reached entry by entry
+                for (int k = i + 1; k <= i + m + 1 && k < n; k++)
+                {
+                    if (!seen[k])
+                    {
+                        seen[k] = 1;
+                        work[top++] = k;
+                    }
+                }
+                falls_through = 0;
+            }
+
+            if (falls_through && i + 1 < n && leader[i + 1])
+            {
+                succ[num_succ++] = i + 1;
+                falls_through = 0;
+            }
+
+            for (int s = 0; s < num_succ; s++)
+            {
+                if (succ[s] >= 0 && succ[s] < n && !seen[succ[s]])
+                {
+                    seen[succ[s]] = 1;
+                    work[top++] = succ[s];
+                }
+            }
+
+            if (!falls_through)
+                break;
+            i++;
+        }
+    }
+
+    int removed = 0;
+    for (int i = 0; i < n; i++)
+        removed += !keep[i];
+    if (removed > 0)
+        compact_code(keep);
+
+    free(leader);
+    free(seen);
+    free(keep);
+    free(work);
+    return removed;
+}
+
+// A JMP to the very next instruction does nothing (the entry JMP stays,
+// and so do JTB table entries, which are selected by position)
+int remove_jumps_to_next()
+{
+    char *keep = malloc((size_t)code_index + 1);
+    if (keep == NULL)
+        error("Out of memory");
+
+    int removed = 0, table_end = 0;
+    for (int i = 0; i < code_index; i++)
+    {
+        if (code[i].op == 10)
+            table_end = i + code[i].m + 1;
+        keep[i] = !(i > table_end && code[i].op == 7 && code[i].m == i + 1);
+        removed += !keep[i];
+    }
+    if (removed > 0)
+        compact_code(keep);
+
+    free(keep);
+    return removed;
+}
+
+// Constant-condition folding plus unreachable block removal, to a fixed point
+void eliminate_dead_code(FILE *out)
+{
+    int before = code_index;
+    int changed;
+    do
+    {
+        changed = fold_constants();
+        changed += remove_unreachable();
+        changed += remove_jumps_to_next();
+    } while (changed > 0);
+
+    int removed = before - code_index;
+    fprintf(out, "\nDead code elimination: %d -> %d instructions (%d removed, %.1f%%)\n",
+            before, code_index, removed, before > 0 ? 100.0 * removed / before : 0.0);
+}
+
+// Move loop records through an old->new index map; loops whose back edge
+// did not survive are dropped (head = -1)
+void remap_loops(const int *map, int old_length)
+{
+    for (int i = 0; i < loop_count; i++)
+    {
+        loop_info *lp = &loops[i];
+        if (lp->head < 0)
+            continue;
+        if (lp->back >= old_length)
+        {
+            lp->head = -1;
+            continue;
+        }
+
+        lp->head = map[lp->head];
+        lp->back = map[lp->back];
+        if (lp->jpc >= 0)
+            lp->jpc = map[lp->jpc];
+
+        if (lp->back >= code_index || code[lp->back].op != 7 || code[lp->back].m != lp->head)
+            lp->head = -1;
+        else if (lp->jpc >= 0 && (lp->jpc <= lp->head || lp->jpc >= lp->back || code[lp->jpc].op != 8))
+            lp->jpc = -1;
+    }
+}
+
+// Operand stack entry while scanning a loop for invariant expressions
+typedef struct
+{
+    int start;     // first instruction computing this value
+    int invariant; // built only from LIT and LODs of unstored variables
+    int may_trap;  // contains a DIV whose divisor may be zero
+} stack_value;
+
+// Hoist maximal invariant expressions of loops[li] into a preheader that
+// stores each one in a new frame slot; the loop then LODs the slot
+int hoist_loop(int li)
+{
+    loop_info lp = loops[li];
+    int h = lp.head, b = lp.back;
+    int cond_end = lp.jpc >= 0 ? lp.jpc : h;
+    int frame = code[inc_index].m;
+
+    char *stored = calloc((size_t)frame + 1, 1);
+    char *target = calloc((size_t)code_index + 1, 1);
+    stack_value *stack = malloc((size_t)(b - h + 1) * sizeof *stack);
+    int *cand_start = malloc((size_t)(b - h + 1) * sizeof *cand_start);
+    int *cand_end = malloc((size_t)(b - h + 1) * sizeof *cand_end);
+    if (stored == NULL || target == NULL || stack == NULL || cand_start == NULL || cand_end == NULL)
+        error("Out of memory");
+
+    for (int i = 0; i < code_index; i++)
+    {
+        if (is_jump(code[i].op) && code[i].m >= 0 && code[i].m <= code_index)
+            target[code[i].m] = 1;
+    }
+    for (int i = h; i <= b; i++)
+    {
+        if (code[i].op == 4 && code[i].m >= 0 && code[i].m <= frame)
+            stored[code[i].m] = 1;
+    }
+
+    // Simulate the operand stack; an invariant value consumed by something
+    // that is not invariant is a maximal candidate
+    int depth = 0, num_cand = 0;
+    for (int i = h; i <= b; i++)
+    {
+        int op = code[i].op, m = code[i].m;
+        if (i > h && target[i])
+            depth = 0;
+
+        stack_value consumed[2] = {{0, 0, 0}, {0, 0, 0}};
+        int num_consumed = 0, result = 0;
+        stack_value value = {i, 0, 0};
+
+        if (op == 1)
+        {
+            value.invariant = 1;
+            result = 1;
+        }
+        else if (op == 3)
+        {
+            value.invariant = code[i].l == 0 && m >= 0 && m <= frame && !stored[m];
+            result = 1;
+        }
+        else if (op == 2 && is_binary_opr(m) && depth >= 2)
+        {
+            stack_value right = stack[--depth], left = stack[--depth];
+            value.start = left.start;
+            value.invariant = left.invariant && right.invariant;
+            value.may_trap = left.may_trap || right.may_trap;
+            if (m == 4 && !(right.start == i - 1 && code[i - 1].op == 1 &&
+                            code[i - 1].m != 0 && code[i - 1].m != -1))
+                value.may_trap = 1;
+            if (!value.invariant)
+            {
+                consumed[num_consumed++] = left;
+                consumed[num_consumed++] = right;
+            }
+            result = 1;
+        }
+        else if (op == 2 && m == 11 && depth >= 1)
+        {
+            value = stack[--depth];
+            result = 1;
+        }
+        else if ((op == 4 || op == 8 || (op == 9 && m == 1)) && depth >= 1)
+            consumed[num_consumed++] = stack[--depth];
+        else if (op == 9 && m == 2)
+            result = 1;
+        else
+            depth = 0;
+
+        for (int c = 0; c < num_consumed; c++)
+        {
+            // The end of a consumed value is just before whatever follows it
+            int start = consumed[c].start;
+            int end = (c == 0 && num_consumed == 2) ? consumed[1].start - 1 : i - 1;
+            int inside_target = 0;
+            for (int k = start + 1; k <= end; k++)
+                inside_target |= target[k];
+
+            // A trapping expression may only move if the loop always runs it
+            if (consumed[c].invariant && end - start >= 2 && !inside_target &&
+                (!consumed[c].may_trap || end < cond_end))
+            {
+                cand_start[num_cand] = start;
+                cand_end[num_cand] = end;
+                num_cand++;
+            }
+        }
+
+        if (result)
+            stack[depth++] = value;
+    }
+
+    free(stored);
+    free(target);
+    free(stack);
+
+    if (num_cand == 0)
+    {
+        free(cand_start);
+        free(cand_end);
+        return 0;
+    }
+
+    // Candidates were found in consumption order; the rewrite needs them by position
+    for (int c = 1; c < num_cand; c++)
+    {
+        int start = cand_start[c], end = cand_end[c], d = c - 1;
+        for (; d >= 0 && cand_start[d] > start; d--)
+        {
+            cand_start[d + 1] = cand_start[d];
+            cand_end[d + 1] = cand_end[d];
+        }
+        cand_start[d + 1] = start;
+        cand_end[d + 1] = end;
+    }
+
+    // Identical expressions share one temporary
+    int *temp_of = malloc((size_t)num_cand * sizeof *temp_of);
+    int *first_use = malloc((size_t)num_cand * sizeof *first_use);
+    if (temp_of == NULL || first_use == NULL)
+        error("Out of memory");
+
+    int num_temps = 0, pre_len = 0, saved = 0;
+    for (int c = 0; c < num_cand; c++)
+    {
+        int len = cand_end[c] - cand_start[c] + 1;
+        temp_of[c] = -1;
+        for (int d = 0; d < c && temp_of[c] < 0; d++)
+        {
+            if (cand_end[d] - cand_start[d] + 1 != len)
+                continue;
+            int same = 1;
+            for (int k = 0; k < len && same; k++)
+            {
+                instruction x = code[cand_start[c] + k], y = code[cand_start[d] + k];
+                same = x.op == y.op && x.l == y.l && x.m == y.m;
+            }
+            if (same)
+                temp_of[c] = temp_of[d];
+        }
+        if (temp_of[c] < 0)
+        {
+            temp_of[c] = frame + num_temps;
+            first_use[num_temps++] = c;
+            pre_len += len + 1;
+        }
+        saved += len - 1;
+    }
+
+    int new_length = code_index + pre_len - saved;
+    if (new_length > MAX_CODE_LENGTH)
+    {
+        free(cand_start);
+        free(cand_end);
+        free(temp_of);
+        free(first_use);
+        return 0;
+    }
+
+    instruction *new_code = malloc((size_t)new_length * sizeof *new_code);
+    int *map = malloc((size_t)(code_index + 1) * sizeof *map);
+    if (new_code == NULL || map == NULL)
+        error("Out of memory");
+
+    int pos = 0;
+    for (int i = 0; i < h; i++)
+    {
+        map[i] = pos;
+        new_code[pos++] = code[i];
+    }
+
+    // Preheader: evaluate each distinct expression once and keep it in a temp
+    for (int t = 0; t < num_temps; t++)
+    {
+        int c = first_use[t];
+        for (int k = cand_start[c]; k <= cand_end[c]; k++)
+            new_code[pos++] = code[k];
+        new_code[pos] = code[cand_end[c]];
+        new_code[pos].op = 4;
+        new_code[pos].l = 0;
+        new_code[pos].m = temp_of[c];
+        pos++;
+    }
+
+    int loop_start = pos, c = 0;
+    for (int i = h; i <= b; i++)
+    {
+        map[i] = pos;
+        if (c < num_cand && i == cand_start[c])
+        {
+            for (int k = i + 1; k <= cand_end[c]; k++)
+                map[k] = pos;
+            new_code[pos] = code[i];
+            new_code[pos].op = 3;
+            new_code[pos].l = 0;
+            new_code[pos].m = temp_of[c];
+            pos++;
+            i = cand_end[c];
+            c++;
+        }
+        else
+            new_code[pos++] = code[i];
+    }
+    int loop_end = pos;
+
+    for (int i = b + 1; i < code_index; i++)
+    {
+        map[i] = pos;
+        new_code[pos++] = code[i];
+    }
+    map[code_index] = pos;
+
+    // Jumps into the loop head from outside now enter through the preheader
+    for (int i = 0; i < pos; i++)
+    {
+        if (!is_jump(new_code[i].op) || new_code[i].m < 0 || new_code[i].m > code_index)
+            continue;
+        if (new_code[i].m == h && (i < loop_start || i >= loop_end))
+            new_code[i].m = h;
+        else
+            new_code[i].m = map[new_code[i].m];
+    }
+
+    memcpy(code, new_code, (size_t)pos * sizeof *code);
+    int old_length = code_index;
+    code_index = pos;
+    inc_index = map[inc_index];
+    code[inc_index].m = frame + num_temps;
+    remap_loops(map, old_length);
+
+    free(cand_start);
+    free(cand_end);
+    free(temp_of);
+    free(first_use);
+    free(new_code);
+    free(map);
+    return num_cand;
+}
+
+// Loops are recorded innermost first, so values hoisted out of an inner
+// loop can be hoisted again by its enclosing loop
+void hoist_loop_invariants(FILE *out)
+{
+    int frame = code[inc_index].m;
+    int hoisted = 0, touched = 0;
+
+    for (int i = 0; i < loop_count; i++)
+    {
+        if (loops[i].head < 0)
+            continue;
+        int n = hoist_loop(i);
+        hoisted += n;
+        touched += n > 0;
+    }
+
+    fprintf(out, "\nLoop-invariant code motion: %d expressions hoisted from %d loops (%d temporaries)\n",
+            hoisted, touched, code[inc_index].m - frame);
+}
+
+// Operand stack entry while simplifying expressions
+typedef struct
+{
+    int start;    // first instruction computing this value
+    int may_trap; // contains a DIV whose divisor may be zero
+} expr_operand;
+
+// Two stretches of code[] hold the same instructions
+int same_code(int x, int y, int len)
+{
+    for (int i = 0; i < len; i++)
+    {
+        if (code[x + i].op != code[y + i].op || code[x + i].l != code[y + i].l || code[x + i].m != code[y + i].m)
+            return 0;
+    }
+    return 1;
+}
+
+// Rewrite the OPR at code[end] (operands left, right) in place; returns
+// the new end of the expression (one past its last instruction), or -1
+// when no rule applies. *shifts counts SHL/SHR introduced
+int simplify_operation(expr_operand left, expr_operand right, int end, int *shifts)
+{
+    instruction op = code[end];
+    int right_len = end - right.start;
+    int left_lit = right.start - left.start == 1 && code[left.start].op == 1;
+    int right_lit = right_len == 1 && code[right.start].op == 1;
+    int a = left_lit ? code[left.start].m : 0;
+    int b = right_lit ? code[right.start].m : 0;
+    int value, k;
+
+    // Both constant: fold unless it would trap
+    if (left_lit && right_lit && fold_binary(a, b, op.m, &value))
+    {
+        code[left.start].m = value;
+        return left.start + 1;
+    }
+
+    // x + 0, x - 0, x * 1, x / 1: the left operand alone
+    if (right_lit && ((b == 0 && (op.m == 1 || op.m == 2)) || (b == 1 && (op.m == 3 || op.m == 4))))
+        return right.start;
+
+    // 0 + x, 1 * x: the right operand alone
+    if (left_lit && ((a == 0 && op.m == 1) || (a == 1 && op.m == 3)))
+    {
+        memmove(&code[left.start], &code[right.start], (size_t)right_len * sizeof *code);
+        return left.start + right_len;
+    }
+
+    // x * 0, 0 * x, x - x: zero, unless dropping x would drop a trap
+    int same = op.m == 2 && right.start - left.start == right_len &&
+               same_code(left.start, right.start, right_len);
+    if ((op.m == 3 && ((right_lit && b == 0 && !left.may_trap) || (left_lit && a == 0 && !right.may_trap))) ||
+        (same && !left.may_trap))
+    {
+        code[left.start] = op;
+        code[left.start].op = 1;
+        code[left.start].l = 0;
+        code[left.start].m = 0;
+        return left.start + 1;
+    }
+
+    // x * 2^k -> x SHL k, x / 2^k -> x SHR k (rounding toward zero like DIV)
+    if (right_lit && (op.m == 3 || op.m == 4) && (k = power_of_two(b)) > 0)
+    {
+        code[right.start].m = k;
+        code[end].m = op.m == 3 ? 12 : 13;
+        (*shifts)++;
+        return end + 1;
+    }
+
+    // 2^k * x -> x SHL k
+    if (left_lit && op.m == 3 && (k = power_of_two(a)) > 0)
+    {
+        instruction lit = code[left.start];
+        memmove(&code[left.start], &code[right.start], (size_t)right_len * sizeof *code);
+        lit.m = k;
+        code[left.start + right_len] = lit;
+        code[left.start + right_len + 1] = op;
+        code[left.start + right_len + 1].m = 12;
+        (*shifts)++;
+        return end + 1;
+    }
+    return -1;
+}
+
+// Apply identity, annihilator and power-of-two rules to every expression
+// while copying code[] onto itself. The operand stack is rebuilt from
+// the output, so a rewrite sees operands that are already simplified;
+// it starts over at jump targets and at anything but LIT, LOD and OPR,
+// so an operand never spans a target except at its first instruction,
+// which a rewrite always leaves at the same place
+int simplify_expressions(int *shifts)
+{
+    int n = code_index;
+    char *target = calloc((size_t)n + 1, 1);
+    int *map = malloc((size_t)(n + 1) * sizeof *map);
+    expr_operand *stack = malloc((size_t)(n + 1) * sizeof *stack);
+    if (target == NULL || map == NULL || stack == NULL)
+        error("Out of memory");
+
+    for (int i = 0; i < n; i++)
+    {
+        if (is_jump(code[i].op) && code[i].m >= 0 && code[i].m <= n)
+            target[code[i].m] = 1;
+    }
+
+    int out = 0, depth = 0, rewrites = 0;
+    for (int i = 0; i < n; i++)
+    {
+        if (target[i])
+            depth = 0;
+        map[i] = out;
+        code[out++] = code[i];
+
+        int op = code[out - 1].op, m = code[out - 1].m;
+        if (op == 1 || op == 3)
+            stack[depth++] = (expr_operand){out - 1, 0};
+        else if (op == 2 && m == 11 && depth >= 1)
+        {
+            if (code[out - 2].op == 1 && stack[depth - 1].start == out - 2)
+            {
+                code[out - 2].m = code[out - 2].m % 2 == 0;
+                out--;
+                rewrites++;
+            }
+        }
+        else if (op == 2 && is_binary_opr(m) && depth >= 2)
+        {
+            expr_operand right = stack[--depth], left = stack[--depth];
+            int end = simplify_operation(left, right, out - 1, shifts);
+            if (end >= 0)
+            {
+                rewrites++;
+                out = end;
+            }
+
+            // Rewrites never add a DIV; one left in place may trap unless
+            // its divisor is a literal other than 0 and -1
+            int may_trap = left.may_trap || right.may_trap;
+            if (end < 0 && m == 4 &&
+                !(right.start == out - 2 && code[out - 2].op == 1 && code[out - 2].m != 0 && code[out - 2].m != -1))
+                may_trap = 1;
+            stack[depth++] = (expr_operand){left.start, may_trap};
+        }
+        else
+            depth = 0;
+    }
+    map[n] = out;
+
+    for (int i = 0; i < out; i++)
+    {
+        if (is_jump(code[i].op) && code[i].m >= 0 && code[i].m <= n)
+            code[i].m = map[code[i].m];
+    }
+    inc_index = map[inc_index];
+    code_index = out;
+    remap_loops(map, n);
+
+    free(target);
+    free(map);
+    free(stack);
+    return rewrites;
+}
+
+// --simplify
+void simplify_algebra(FILE *out)
+{
+    int before = code_index, shifts = 0;
+    int rewrites = simplify_expressions(&shifts);
+    fprintf(out, "\nAlgebraic simplification: %d -> %d instructions (%d rewrites, %d multiplies/divides made shifts)\n",
+            before, code_index, rewrites, shifts);
+}
+
+// The frame slots the code touches are all main-level LOD/STO within the
+// INC'd frame, and there are no calls or returns to carry values between
+// frames; --dse only runs when that holds
+int frame_is_local()
+{
+    int frame = code[inc_index].m;
+    for (int i = 0; i < code_index; i++)
+    {
+        int op = code[i].op;
+        if (op == 5 || (op == 2 && code[i].m == 0))
+            return 0;
+        if ((op == 3 || op == 4) && (code[i].l != 0 || code[i].m < 3 || code[i].m >= frame))
+            return 0;
+    }
+    return 1;
+}
+
+// First instruction of the value a STO at code[end] stores, or -1 when
+// that code cannot simply be dropped: it must stay inside block_start..,
+// consist of LIT, LOD and OPR only (SYS 0 2 consumes input) and divide
+// only by nonzero literals, so removing it removes no runtime error
+int removable_value(int end, int block_start)
+{
+    int need = 1;
+    for (int j = end - 1; j >= block_start; j--)
+    {
+        int op = code[j].op, m = code[j].m;
+        if (op == 1 || op == 3)
+            need--;
+        else if (op == 2 && m == 11)
+            ;
+        else if (op == 2 && is_binary_opr(m))
+        {
+            if (m == 4 && !(code[j - 1].op == 1 && code[j - 1].m != 0))
+                return -1;
+            need++;
+        }
+        else
+            return -1;
+
+        if (need == 0)
+            return j;
+    }
+    return -1;
+}
+
+// Slots live after code[end], the last instruction of a block: the union
+// of live_in over the blocks it can go to. A JTB goes to every entry of
+// its table; nothing is live after a halt
+void live_after(int end, const int *block_of, const uint64_t *live_in, int words, uint64_t *live)
+{
+    int op = code[end].op, m = code[end].m;
+    int next_last = op == 10 ? end + m + 1 : (op == 7 || (op == 9 && m == 3)) ? end : end + 1;
+    if (next_last >= code_index)
+        next_last = code_index - 1;
+
+    memset(live, 0, (size_t)words * sizeof *live);
+    for (int k = end + 1; k <= next_last; k++)
+    {
+        for (int w = 0; w < words; w++)
+            live[w] |= live_in[(size_t)block_of[k] * words + w];
+    }
+    if ((op == 7 || op == 8) && m >= 0 && m < code_index)
+    {
+        for (int w = 0; w < words; w++)
+            live[w] |= live_in[(size_t)block_of[m] * words + w];
+    }
+}
+
+// One round of liveness over the frame slots: a STO whose slot is not
+// read again before the next STO to it (on any path) is dead, and goes
+// with its value when removable_value allows. Returns the instructions
+// removed, or -1 when the bitsets would be unreasonably large
+int remove_dead_stores(int *stores)
+{
+    int n = code_index;
+    int words = (code[inc_index].m + 63) / 64;
+
+    // Basic blocks: leaders are the entry, jump targets and whatever
+    // follows a jump or halt
+    char *leader = calloc((size_t)n + 1, 1);
+    int *block_of = malloc((size_t)n * sizeof *block_of);
+    if (leader == NULL || block_of == NULL)
+        error("Out of memory");
+    leader[0] = 1;
+    for (int i = 0; i < n; i++)
+    {
+        int op = code[i].op;
+        if (is_jump(op) && code[i].m >= 0 && code[i].m < n)
+            leader[code[i].m] = 1;
+        if (op == 7 || op == 8 || op == 10 || (op == 9 && code[i].m == 3))
+            leader[i + 1] = 1;
+    }
+    int num_blocks = 0;
+    for (int i = 0; i < n; i++)
+    {
+        num_blocks += leader[i];
+        block_of[i] = num_blocks - 1;
+    }
+    if ((double)num_blocks * words * 2 * sizeof(uint64_t) > 256.0 * 1024 * 1024)
+    {
+        free(leader);
+        free(block_of);
+        return -1;
+    }
+
+    int *first = malloc((size_t)num_blocks * sizeof *first);
+    int *last = malloc((size_t)num_blocks * sizeof *last);
+    uint64_t *live_in = calloc((size_t)num_blocks * words, sizeof *live_in);
+    uint64_t *live = malloc((size_t)words * sizeof *live);
+    char *keep = malloc((size_t)n + 1);
+    if (first == NULL || last == NULL || live_in == NULL || live == NULL || keep == NULL)
+        error("Out of memory");
+    for (int i = 0; i < n; i++)
+    {
+        if (leader[i])
+            first[block_of[i]] = i;
+        last[block_of[i]] = i;
+        keep[i] = 1;
+    }
+
+    // Backward data flow to a fixed point; live-out of a block is the union
+    // of its successors' live-in, nothing is live after a halt
+    int changed;
+    do
+    {
+        changed = 0;
+        for (int b = num_blocks - 1; b >= 0; b--)
+        {
+            int end = last[b];
+            live_after(end, block_of, live_in, words, live);
+            for (int i = end; i >= first[b]; i--)
+            {
+                int slot = code[i].m;
+                if (code[i].op == 4)
+                    live[slot / 64] &= ~(1ULL << (slot % 64));
+                else if (code[i].op == 3)
+                    live[slot / 64] |= 1ULL << (slot % 64);
+            }
+            uint64_t *in = &live_in[(size_t)b * words];
+            if (memcmp(in, live, (size_t)words * sizeof *live) != 0)
+            {
+                memcpy(in, live, (size_t)words * sizeof *live);
+                changed = 1;
+            }
+        }
+    } while (changed);
+
+    // Same walk once more, now dropping the dead stores
+    int removed = 0;
+    for (int b = 0; b < num_blocks; b++)
+    {
+        int end = last[b];
+        live_after(end, block_of, live_in, words, live);
+        for (int i = end; i >= first[b]; i--)
+        {
+            int slot = code[i].m;
+            if (code[i].op == 4)
+            {
+                int start;
+                if (!(live[slot / 64] & (1ULL << (slot % 64))) &&
+                    (start = removable_value(i, first[b])) >= 0)
+                {
+                    for (int k = start; k <= i; k++)
+                        keep[k] = 0;
+                    removed += i - start + 1;
+                    (*stores)++;
+                    i = start;
+                    continue;
+                }
+                live[slot / 64] &= ~(1ULL << (slot % 64));
+            }
+            else if (code[i].op == 3)
+                live[slot / 64] |= 1ULL << (slot % 64);
+        }
+    }
+    if (removed > 0)
+        compact_code(keep);
+
+    free(leader);
+    free(block_of);
+    free(first);
+    free(last);
+    free(live_in);
+    free(live);
+    free(keep);
+    return removed;
+}
+
+// Renumber the slots still loaded or stored to 3, 4, ... in order and
+// shrink the INC; variables left without a slot get address 0
+void compact_frame()
+{
+    int frame = code[inc_index].m;
+    int *slot_map = malloc((size_t)frame * sizeof *slot_map);
+    if (slot_map == NULL)
+        error("Out of memory");
+    for (int a = 0; a < frame; a++)
+        slot_map[a] = a < 3 ? a : 0;
+
+    for (int i = 0; i < code_index; i++)
+    {
+        if (code[i].op == 3 || code[i].op == 4)
+            slot_map[code[i].m] = 1;
+    }
+    int next = 3;
+    for (int a = 3; a < frame; a++)
+        slot_map[a] = slot_map[a] ? next++ : 0;
+
+    for (int i = 0; i < code_index; i++)
+    {
+        if (code[i].op == 3 || code[i].op == 4)
+            code[i].m = slot_map[code[i].m];
+    }
+    for (int s = 0; s < symbol_table_index; s++)
+    {
+        if (symbol_table[s].kind == 2 && symbol_table[s].addr >= 3 && symbol_table[s].addr < frame)
+            symbol_table[s].addr = slot_map[symbol_table[s].addr];
+    }
+    code[inc_index].m = next;
+    free(slot_map);
+}
+
+// --dse: dead stores to a fixed point (dropping one store's value can
+// leave an earlier store dead), then the dense frame
+void eliminate_dead_stores(FILE *out)
+{
+    if (!frame_is_local())
+    {
+        fprintf(out, "\nDead store elimination: skipped (code uses frames other than main's)\n");
+        return;
+    }
+
+    int before = code_index, frame = code[inc_index].m, stores = 0, removed;
+    while ((removed = remove_dead_stores(&stores)) > 0)
+        ;
+    if (removed < 0)
+    {
+        fprintf(out, "\nDead store elimination: skipped (too large)\n");
+        return;
+    }
+    compact_frame();
+
+    fprintf(out, "\nDead store elimination: %d -> %d instructions (%d stores removed), frame %d -> %d slots\n",
+            before, code_index, stores, frame, code[inc_index].m);
+}
+
+// Merge what another path knows into a block's entry state; returns 1 if
+// the state changed. Anything the paths disagree on varies
+int meet_values(slot_value *into, const slot_value *from, int frame)
+{
+    int changed = 0;
+    for (int a = 3; a < frame; a++)
+    {
+        if (from[a].kind == VALUE_UNKNOWN || into[a].kind == VALUE_VARYING)
+            continue;
+        if (into[a].kind == VALUE_UNKNOWN)
+            into[a] = from[a];
+        else if (into[a].kind != from[a].kind || into[a].value != from[a].value)
+            into[a].kind = VALUE_VARYING;
+        else
+            continue;
+        changed = 1;
+    }
+    return changed;
+}
+
+// Effect of the STO at code[i] on state: the literal or slot loaded just
+// before it (in the same block) is known, anything else varies. Slots
+// that were copies of the stored one no longer are
+void transfer_store(slot_value *state, int i, int frame, int block_start)
+{
+    int a = code[i].m;
+    slot_value v = {VALUE_VARYING, 0};
+    if (i > block_start && code[i - 1].op == 1)
+    {
+        v.kind = VALUE_CONST;
+        v.value = code[i - 1].m;
+    }
+    else if (i > block_start && code[i - 1].op == 3)
+    {
+        int b = code[i - 1].m;
+        if (b == a || (state[b].kind == VALUE_COPY && state[b].value == a))
+            return; // a := a
+        if (state[b].kind == VALUE_CONST || state[b].kind == VALUE_COPY)
+            v = state[b];
+        else
+        {
+            v.kind = VALUE_COPY;
+            v.value = b;
+        }
+    }
+
+    for (int x = 3; x < frame; x++)
+    {
+        if (state[x].kind == VALUE_COPY && state[x].value == a)
+            state[x].kind = VALUE_VARYING;
+    }
+    state[a] = v;
+}
+
+// One round of --constprop: solve the data flow from the entry (where
+// every slot varies), then rewrite the LODs it resolves. Returns the LODs
+// rewritten, or -1 when the states would be unreasonably large
+int rewrite_known_loads(int *constants, int *copies)
+{
+    int n = code_index;
+    int frame = code[inc_index].m;
+
+    // Basic blocks, as for --dse
+    char *leader = calloc((size_t)n + 1, 1);
+    int *block_of = malloc((size_t)n * sizeof *block_of);
+    if (leader == NULL || block_of == NULL)
+        error("Out of memory");
+    leader[0] = 1;
+    for (int i = 0; i < n; i++)
+    {
+        int op = code[i].op;
+        if (is_jump(op) && code[i].m >= 0 && code[i].m < n)
+            leader[code[i].m] = 1;
+        if (op == 7 || op == 8 || op == 10 || (op == 9 && code[i].m == 3))
+            leader[i + 1] = 1;
+    }
+    int num_blocks = 0;
+    for (int i = 0; i < n; i++)
+    {
+        num_blocks += leader[i];
+        block_of[i] = num_blocks - 1;
+    }
+    if ((double)num_blocks * frame * sizeof(slot_value) > 256.0 * 1024 * 1024)
+    {
+        free(leader);
+        free(block_of);
+        return -1;
+    }
+
+    int *first = malloc((size_t)num_blocks * sizeof *first);
+    int *last = malloc((size_t)num_blocks * sizeof *last);
+    slot_value *in = calloc((size_t)num_blocks * frame, sizeof *in);
+    slot_value *state = malloc((size_t)frame * sizeof *state);
+    int *work = malloc((size_t)num_blocks * sizeof *work);
+    char *queued = calloc((size_t)num_blocks, 1);
+    char *reached = calloc((size_t)num_blocks, 1);
+    if (first == NULL || last == NULL || in == NULL || state == NULL || work == NULL || queued == NULL ||
+        reached == NULL)
+        error("Out of memory");
+    for (int i = 0; i < n; i++)
+    {
+        if (leader[i])
+            first[block_of[i]] = i;
+        last[block_of[i]] = i;
+    }
+
+    // Forward data flow to a fixed point over a worklist of blocks whose
+    // entry state changed (a circular queue: each block is in it once)
+    for (int a = 3; a < frame; a++)
+        in[a].kind = VALUE_VARYING;
+    reached[0] = queued[0] = 1;
+    int head = 0, count = 1;
+    work[0] = 0;
+    while (count > 0)
+    {
+        int b = work[head];
+        head = (head + 1) % num_blocks;
+        count--;
+        queued[b] = 0;
+
+        memcpy(state, &in[(size_t)b * frame], (size_t)frame * sizeof *state);
+        for (int i = first[b]; i <= last[b]; i++)
+        {
+            if (code[i].op == 4)
+                transfer_store(state, i, frame, first[b]);
+        }
+
+        // Successors: a JMP's target, a JPC's target and the next block,
+        // every entry of a JTB's table, nothing after a halt
+        int end = last[b], op = code[end].op, m = code[end].m;
+        int next_last = op == 10 ? end + m + 1 : (op == 7 || (op == 9 && m == 3)) ? end : end + 1;
+        if (next_last >= n)
+            next_last = n - 1;
+        for (int k = end + 1; k <= next_last + 1; k++)
+        {
+            int target = k <= next_last ? k : (op == 7 || op == 8) ? m : -1;
+            if (target < 0 || target >= n)
+                continue;
+            int s = block_of[target];
+            if ((meet_values(&in[(size_t)s * frame], state, frame) || !reached[s]) && !queued[s])
+            {
+                work[(head + count) % num_blocks] = s;
+                count++;
+                queued[s] = 1;
+            }
+            reached[s] = 1;
+        }
+    }
+
+    // Rewrite the LODs of each reached block from its entry state
+    int rewritten = 0;
+    for (int b = 0; b < num_blocks; b++)
+    {
+        if (!reached[b])
+            continue;
+        memcpy(state, &in[(size_t)b * frame], (size_t)frame * sizeof *state);
+        for (int i = first[b]; i <= last[b]; i++)
+        {
+            int a = code[i].m;
+            if (code[i].op == 4)
+                transfer_store(state, i, frame, first[b]);
+            else if (code[i].op == 3 && state[a].kind == VALUE_CONST)
+            {
+                code[i].op = 1;
+                code[i].m = state[a].value;
+                (*constants)++;
+                rewritten++;
+            }
+            else if (code[i].op == 3 && state[a].kind == VALUE_COPY)
+            {
+                code[i].m = state[a].value;
+                (*copies)++;
+                rewritten++;
+            }
+        }
+    }
+
+    free(leader);
+    free(block_of);
+    free(first);
+    free(last);
+    free(in);
+    free(state);
+    free(work);
+    free(queued);
+    free(reached);
+    return rewritten;
+}
+
+// --constprop: propagate, fold what became constant, and repeat while
+// folding still removes code (only folding teaches the flow anything new)
+void propagate_constants(FILE *out)
+{
+    if (!frame_is_local())
+    {
+        fprintf(out, "\nConstant propagation: skipped (code uses frames other than main's)\n");
+        return;
+    }
+
+    int before = code_index, constants = 0, copies = 0, folded = 0, round;
+    do
+    {
+        if (rewrite_known_loads(&constants, &copies) < 0)
+        {
+            fprintf(out, "\nConstant propagation: skipped (too large)\n");
+            return;
+        }
+        round = fold_constants();
+        folded += round;
+    } while (round > 0);
+
+    fprintf(out, "\nConstant propagation: %d -> %d instructions (%d loads made literals, %d made copies, %d folded away)\n",
+            before, code_index, constants, copies, folded);
+}
+
+// Run code[] the way vm.c's run() would, collecting the values written.
+// Returns NULL when it halts (at *halt_pc), otherwise why the run cannot
+// stand in for the program (the reason for the listing)
+const char *evaluate_program(eval_write **writes, int *num_writes, int *halt_pc, long long *steps)
+{
+    int *stack = calloc(EVAL_STACK_HEIGHT, sizeof *stack);
+    int capacity = 64;
+    *writes = malloc((size_t)capacity * sizeof **writes);
+    *num_writes = 0;
+    *steps = 0;
+    if (stack == NULL || *writes == NULL)
+        error("Out of memory");
+
+    const char *reason = NULL;
+    int pc = 0, bp = 0, sp = -1;
+    while (reason == NULL)
+    {
+        if (*steps >= PRECOMPUTE_STEPS)
+        {
+            reason = "step budget exceeded";
+            break;
+        }
+        if (pc < 0 || pc >= code_index)
+        {
+            reason = "runtime error";
+            break;
+        }
+        instruction ir = code[pc++];
+        (*steps)++;
+
+        // Static links and operands must stay on the stack; the vm would
+        // stop with an error wherever this does
+        int at = bp;
+        for (int l = ir.l; l > 0 && at >= 0 && at < EVAL_STACK_HEIGHT; l--)
+            at = stack[at];
+        at += ir.m;
+
+        switch (ir.op)
+        {
+        case 1: // LIT
+            if (sp + 1 >= EVAL_STACK_HEIGHT)
+                reason = "runtime error";
+            else
+                stack[++sp] = ir.m;
+            break;
+
+        case 2: // OPR
+            if (ir.m == 0)
+            {
+                if (bp < 0 || bp + 2 >= EVAL_STACK_HEIGHT)
+                {
+                    reason = "runtime error";
+                    break;
+                }
+                sp = bp - 1;
+                pc = stack[bp + 2];
+                bp = stack[bp + 1];
+            }
+            else if (ir.m == 11 && sp >= 0)
+                stack[sp] = stack[sp] % 2 == 0;
+            else if (sp >= 1 && is_binary_opr(ir.m))
+            {
+                int a = stack[sp - 1], b = stack[sp], r;
+                if (ir.m == 4 && b == 0)
+                    reason = "runtime error";
+                else if (ir.m == 4 && a == INT_MIN && b == -1)
+                    stack[--sp] = a; // as vm.c's DIV
+                else if (fold_binary(a, b, ir.m, &r))
+                    stack[--sp] = r;
+            }
+            else
+                reason = "runtime error";
+            break;
+
+        case 3: // LOD
+            if (at < 0 || at >= EVAL_STACK_HEIGHT || sp + 1 >= EVAL_STACK_HEIGHT)
+                reason = "runtime error";
+            else
+            {
+                stack[sp + 1] = stack[at];
+                sp++;
+            }
+            break;
+
+        case 4: // STO
+            if (at < 0 || at >= EVAL_STACK_HEIGHT || sp < 0)
+                reason = "runtime error";
+            else
+                stack[at] = stack[sp--];
+            break;
+
+        case 5: // CAL
+            at -= ir.m;
+            if (sp + 3 >= EVAL_STACK_HEIGHT || sp + 1 < 0)
+            {
+                reason = "runtime error";
+                break;
+            }
+            stack[sp + 1] = at;
+            stack[sp + 2] = bp;
+            stack[sp + 3] = pc;
+            bp = sp + 1;
+            pc = ir.m;
+            break;
+
+        case 6: // INC
+            if (sp + ir.m >= EVAL_STACK_HEIGHT || sp + ir.m < -1)
+                reason = "runtime error";
+            else
+                sp += ir.m;
+            break;
+
+        case 7: // JMP
+            pc = ir.m;
+            break;
+
+        case 8: // JPC
+            if (sp < 0)
+                reason = "runtime error";
+            else if (stack[sp--] == 0)
+                pc = ir.m;
+            break;
+
+        case 9: // SYS
+            if (ir.m == 1 && sp >= 0)
+            {
+                if (*num_writes == capacity)
+                {
+                    capacity *= 2;
+                    eval_write *grown = realloc(*writes, (size_t)capacity * sizeof *grown);
+                    if (grown == NULL)
+                        error("Out of memory");
+                    *writes = grown;
+                }
+                (*writes)[*num_writes].value = stack[sp--];
+                (*writes)[*num_writes].pc = pc - 1;
+                (*num_writes)++;
+            }
+            else if (ir.m == 2)
+                reason = "program reads input";
+            else if (ir.m == 3)
+            {
+                *halt_pc = pc - 1;
+                free(stack);
+                return NULL;
+            }
+            else
+                reason = "runtime error";
+            break;
+
+        case 10: // JTB
+            if (sp < 0 || pc + ir.m >= code_index)
+                reason = "runtime error";
+            else
+            {
+                int index = stack[sp--];
+                pc = code[pc + ((unsigned)index < (unsigned)ir.m ? index : ir.m)].m;
+            }
+            break;
+
+        default:
+            reason = "runtime error";
+        }
+    }
+
+    free(stack);
+    return reason;
+}
+
+// --precompute: replace a program that halts without reading input by
+// the writes it makes, each keeping its write's source position for -g
+void precompute_program(FILE *out)
+{
+    eval_write *writes;
+    int num_writes, halt_pc = 0;
+    long long steps;
+    const char *reason = evaluate_program(&writes, &num_writes, &halt_pc, &steps);
+    if (reason == NULL && 2 * num_writes + 3 > MAX_CODE_LENGTH)
+        reason = "output does not fit the code segment";
+    if (reason != NULL)
+    {
+        fprintf(out, "\nCompile-time evaluation: skipped (%s after %lld instructions)\n", reason, steps);
+        free(writes);
+        return;
+    }
+
+    // Positions come from the old code, which the new code overwrites
+    instruction first = code[0], inc = code[inc_index], halt = code[halt_pc];
+    int *positions = malloc((size_t)(2 * num_writes + 1) * sizeof *positions);
+    if (positions == NULL)
+        error("Out of memory");
+    for (int k = 0; k < num_writes; k++)
+    {
+        positions[2 * k] = code[writes[k].pc].line;
+        positions[2 * k + 1] = code[writes[k].pc].column;
+    }
+
+    int before = code_index;
+    code_index = 0;
+    emit_at(7, 0, 1, first.line, first.column);
+    emit_at(6, 0, 3, inc.line, inc.column);
+    for (int k = 0; k < num_writes; k++)
+    {
+        emit_at(1, 0, writes[k].value, positions[2 * k], positions[2 * k + 1]);
+        emit_at(9, 0, 1, positions[2 * k], positions[2 * k + 1]);
+    }
+    emit_at(9, 0, 3, halt.line, halt.column);
+    free(positions);
+    inc_index = 1;
+    loop_count = 0;
+
+    for (int s = 0; s < symbol_table_index; s++)
+    {
+        if (symbol_table[s].kind == 2)
+            symbol_table[s].addr = 0;
+    }
+
+    fprintf(out, "\nCompile-time evaluation: %d -> %d instructions (%d values written, %lld instructions run)\n",
+            before, code_index, num_writes, steps);
+    free(writes);
+}
+
+// FNV-1a over the program as write_elf_file would spell it (matches vm.c)
+uint64_t code_checksum()
+{
+    uint64_t hash = 0xcbf29ce484222325ULL;
+    char text[64];
+    for (int i = 0; i < code_index; i++)
+    {
+        int op = code[i].op, l = code[i].l, m = code[i].m;
+        if (is_jump(op))
+            m = m * 3;
+        int len = snprintf(text, sizeof text, "%d %d %d\n", op, l, m);
+        hash = hash_bytes(hash, text, (size_t)len);
+    }
+    return hash;
+}
+
+// Order rows by source position
+int compare_profile_rows(const void *a, const void *b)
+{
+    const profile_row *x = a, *y = b;
+    if (x->line != y->line)
+        return x->line < y->line ? -1 : 1;
+    if (x->column != y->column)
+        return x->column < y->column ? -1 : 1;
+    return 0;
+}
+
+// Fill code[].count from a profile. The exact code the profile ran is
+// matched by index; anything else falls back to source positions, taking
+// the hottest row recorded for each line:col
+profile_match load_profile(const char *path, long long *total, int *matched)
+{
+    *total = 0;
+    *matched = 0;
+
+    FILE *f = fopen(path, "r");
+    if (f == NULL)
+    {
+        fprintf(stderr, "Warning: Cannot open profile %s; ignored\n", path);
+        return PROFILE_UNUSED;
+    }
+
+    int version, length;
+    unsigned long long checksum;
+    if (fscanf(f, "PL0PROF %d code %d %llx total %lld", &version, &length, &checksum, total) != 4 || version != 1)
+    {
+        fprintf(stderr, "Warning: %s is not a PL0PROF 1 profile; ignored\n", path);
+        fclose(f);
+        return PROFILE_UNUSED;
+    }
+
+    int capacity = 256, num_rows = 0;
+    profile_row *rows = malloc((size_t)capacity * sizeof *rows);
+    profile_row row;
+    while (rows != NULL && fscanf(f, "%d %lld %d %d", &row.pc, &row.count, &row.line, &row.column) == 4)
+    {
+        if (num_rows == capacity)
+        {
+            capacity *= 2;
+            profile_row *grown = realloc(rows, (size_t)capacity * sizeof *rows);
+            if (grown == NULL)
+                free(rows);
+            rows = grown;
+            if (rows == NULL)
+                break;
+        }
+        rows[num_rows++] = row;
+    }
+    fclose(f);
+    if (rows == NULL)
+        error("Out of memory");
+
+    profile_match match = PROFILE_UNUSED;
+    if (length == code_index && checksum == code_checksum())
+    {
+        for (int r = 0; r < num_rows; r++)
+        {
+            if (rows[r].pc >= 0 && rows[r].pc < code_index)
+                code[rows[r].pc].count = rows[r].count;
+        }
+        *matched = code_index;
+        match = PROFILE_BY_INDEX;
+    }
+    else if (debug_info)
+    {
+        // Keep the largest count per position
+        qsort(rows, (size_t)num_rows, sizeof *rows, compare_profile_rows);
+        int unique = 0;
+        for (int r = 0; r < num_rows; r++)
+        {
+            if (rows[r].line <= 0)
+                continue;
+            if (unique > 0 && compare_profile_rows(&rows[unique - 1], &rows[r]) == 0)
+            {
+                if (rows[r].count > rows[unique - 1].count)
+                    rows[unique - 1].count = rows[r].count;
+            }
+            else
+                rows[unique++] = rows[r];
+        }
+
+        for (int i = 0; i < code_index; i++)
+        {
+            profile_row key = {0, 0, code[i].line, code[i].column};
+            profile_row *hit = bsearch(&key, rows, (size_t)unique, sizeof *rows, compare_profile_rows);
+            if (hit != NULL)
+            {
+                code[i].count = hit->count;
+                (*matched)++;
+            }
+        }
+        if (*matched > 0)
+            match = PROFILE_BY_POSITION;
+    }
+
+    if (match == PROFILE_UNUSED)
+        fprintf(stderr, "Warning: profile %s was taken from different code; ignored "
+                        "(build and profile with -g to match by source position)\n", path);
+    free(rows);
+    return match;
+}
+
+// EQL<->NEQ, LSS<->GEQ, LEQ<->GTR; -1 for anything else
+int negate_relop(int subop)
+{
+    switch (subop)
+    {
+    case 5:
+        return 6;
+    case 6:
+        return 5;
+    case 7:
+        return 10;
+    case 8:
+        return 9;
+    case 9:
+        return 8;
+    case 10:
+        return 7;
+    default:
+        return -1;
+    }
+}
+
+// Install new_code, moving jump targets, inc_index and loop records through
+// map (old index -> new index); jumps with fixed[i] set already hold new targets
+void relocate_code(instruction *new_code, int new_length, const int *map, const char *fixed)
+{
+    for (int i = 0; i < new_length; i++)
+    {
+        if (!fixed[i] && is_jump(new_code[i].op) && new_code[i].m >= 0 && new_code[i].m <= code_index)
+            new_code[i].m = map[new_code[i].m];
+    }
+
+    memcpy(code, new_code, (size_t)new_length * sizeof *code);
+    int old_length = code_index;
+    code_index = new_length;
+    inc_index = map[inc_index];
+    remap_loops(map, old_length);
+}
+
+// while: head: cond; JPC exit; body; JMP head; exit:
+// becomes head: cond; JPC exit; body; cond'; JPC body; exit:
+// where cond' ends in the negated relop, so a taken JPC continues the loop
+int invert_loop(int li)
+{
+    loop_info lp = loops[li];
+    int h = lp.head, j = lp.jpc, b = lp.back;
+    if (h < 0 || j <= h || code[j - 1].op != 2 || negate_relop(code[j - 1].m) < 0)
+        return 0;
+
+    int cond_len = j - h;
+    int new_length = code_index + cond_len;
+    if (new_length > MAX_CODE_LENGTH)
+        return 0;
+
+    instruction *new_code = malloc((size_t)new_length * sizeof *new_code);
+    int *map = malloc((size_t)(code_index + 1) * sizeof *map);
+    char *fixed = calloc((size_t)new_length, 1);
+    if (new_code == NULL || map == NULL || fixed == NULL)
+        error("Out of memory");
+
+    int pos = 0;
+    for (int i = 0; i < b; i++)
+    {
+        map[i] = pos;
+        new_code[pos++] = code[i];
+    }
+
+    // Jumps to the old back edge (an if ending the body) reach the new test
+    map[b] = pos;
+    for (int i = h; i < j; i++)
+        new_code[pos++] = code[i];
+    new_code[pos - 1].m = negate_relop(code[j - 1].m);
+    new_code[pos] = code[b];
+    new_code[pos].op = 8;
+    new_code[pos].m = j + 1;
+    fixed[pos] = 1;
+    pos++;
+
+    for (int i = b + 1; i < code_index; i++)
+    {
+        map[i] = pos;
+        new_code[pos++] = code[i];
+    }
+    map[code_index] = pos;
+
+    relocate_code(new_code, pos, map, fixed);
+    loops[li].head = -1; // no longer a JMP back edge
+
+    free(new_code);
+    free(map);
+    free(fixed);
+    return 1;
+}
+
+// if: cond; JPC after; body; after:
+// becomes cond'; JPC cold; after: ... HALT; cold: body; JMP after
+int move_cold_branch(int j)
+{
+    int t = code[j].m;
+    int n = code_index;
+    if (j < 1 || t <= j + 1 || t >= n || code[j - 1].op != 2 || negate_relop(code[j - 1].m) < 0)
+        return 0;
+    if (n + 1 > MAX_CODE_LENGTH)
+        return 0;
+
+    instruction *new_code = malloc((size_t)(n + 1) * sizeof *new_code);
+    int *map = malloc((size_t)(n + 1) * sizeof *map);
+    char *fixed = calloc((size_t)n + 1, 1);
+    if (new_code == NULL || map == NULL || fixed == NULL)
+        error("Out of memory");
+
+    int pos = 0;
+    for (int i = 0; i <= j; i++)
+    {
+        map[i] = pos;
+        new_code[pos++] = code[i];
+    }
+    for (int i = t; i < n; i++)
+    {
+        map[i] = pos;
+        new_code[pos++] = code[i];
+    }
+    int cold = pos;
+    for (int i = j + 1; i < t; i++)
+    {
+        map[i] = pos;
+        new_code[pos++] = code[i];
+    }
+    map[n] = cold;
+
+    new_code[j - 1].m = negate_relop(code[j - 1].m);
+    new_code[j].m = cold;
+    fixed[j] = 1;
+    new_code[pos] = code[j];
+    new_code[pos].op = 7;
+    new_code[pos].m = map[t];
+    new_code[pos].count = 0;
+    fixed[pos] = 1;
+    pos++;
+
+    relocate_code(new_code, pos, map, fixed);
+
+    free(new_code);
+    free(map);
+    free(fixed);
+    return 1;
+}
+
+// Profile-driven layout. Cold if bodies move first (from the end, so the
+// indices still to be visited stay put), then hot loops are inverted
+void apply_profile(FILE *out)
+{
+    long long total;
+    int matched;
+    profile_match match = load_profile(profile_path, &total, &matched);
+    if (match == PROFILE_UNUSED)
+    {
+        fprintf(out, "\nProfile-guided optimization: profile not used\n");
+        return;
+    }
+
+    int moved = 0, inverted = 0, live_loops = 0;
+
+    // Cold code goes after the HALT, which must end the program
+    if (code_index > 0 && code[code_index - 1].op == 9 && code[code_index - 1].m == 3)
+    {
+        char *target = calloc((size_t)code_index + 1, 1);
+        char *loop_exit = calloc((size_t)code_index + 1, 1);
+        if (target == NULL || loop_exit == NULL)
+            error("Out of memory");
+        for (int i = 0; i < code_index; i++)
+        {
+            if (is_jump(code[i].op) && code[i].m >= 0 && code[i].m <= code_index)
+                target[code[i].m] = 1;
+        }
+        for (int i = 0; i < loop_count; i++)
+        {
+            if (loops[i].head >= 0 && loops[i].jpc >= 0)
+                loop_exit[loops[i].jpc] = 1;
+        }
+
+        // Moving a body only relocates code after j, so the flags stay valid
+        for (int j = code_index - 1; j > 0; j--)
+        {
+            if (code[j].op != 8 || loop_exit[j] || target[j] || code[j].m <= j + 1)
+                continue;
+            if (code[j].count == 0 || code[j + 1].count * PGO_COLD_RATIO >= code[j].count)
+                continue;
+            moved += move_cold_branch(j);
+        }
+        free(target);
+        free(loop_exit);
+    }
+
+    for (int i = 0; i < loop_count; i++)
+    {
+        if (loops[i].head < 0 || loops[i].jpc < 0)
+            continue;
+        live_loops++;
+
+        long long executed = 0;
+        for (int k = loops[i].head; k <= loops[i].back; k++)
+            executed += code[k].count;
+        if (code[loops[i].back].count > 0 && executed * 100 >= total * PGO_HOT_PERCENT)
+            inverted += invert_loop(i);
+    }
+
+    fprintf(out, "\nProfile-guided optimization: %d of %d loops inverted, %d cold if bodies moved out of line\n",
+            inverted, live_loops, moved);
+    if (match == PROFILE_BY_INDEX)
+        fprintf(out, "(profile matched by instruction index)\n");
+    else
+        fprintf(out, "(stale profile matched by source position: %d of %d instructions)\n", matched, code_index);
+}
+
+// Print assembly code to terminal
+void print_assembly(FILE *out)
+{
+    fprintf(out, "\nAssembly Code:\n");
+    fprintf(out, "Line OP L M\n");
+
+    for (int i = 0; i < code_index; i++)
+    { // start at 0
+        int op = code[i].op, l = code[i].l, m = code[i].m;
+        // match elf.txt formatting: scale targets for CAL/JMP/JPC
+        if (op == 5 || op == 7 || op == 8)
+            m = m * 3;
+        if (debug_info)
+            fprintf(out, "%d %s %d %d\t; %d:%d\n", i, op_names[op], l, m, code[i].line, code[i].column);
+        else
+            fprintf(out, "%d %s %d %d\n", i, op_names[op], l, m);
+    }
+
+    fprintf(out, "Symbol Table:\n");
+    fprintf(out, "Kind | Name | Value | Level | Address | Mark\n");
+    fprintf(out, "---------------------------------------------------\n");
+    for (int i = 0; i < symbol_table_index; i++)
+    {
+        fprintf(out, "%d | %s | %d | %d | %d | %d\n",
                symbol_table[i].kind,
                symbol_table[i].name,
                symbol_table[i].val,
@@ -702,3 +3842,187 @@ void write_elf_file()
     }
     fclose(elf);
 }
+
+// Write elf.lines: a row only where the source position changes, with the
+// instruction index and line stored as deltas from the previous row
+void write_line_table()
+{
+    FILE *f = fopen("elf.lines", "w");
+    if (!f)
+    {
+        fprintf(stderr, "Error: Cannot create elf.lines\n");
+        return;
+    }
+
+    int rows = 0;
+    for (int i = 0; i < code_index; i++)
+    {
+        if (i == 0 || code[i].line != code[i - 1].line || code[i].column != code[i - 1].column)
+            rows++;
+    }
+
+    fprintf(f, "PL0LINES 2 %d %016llx\n%d\n", code_index, (unsigned long long)code_checksum(), rows);
+    int last_pc = 0, last_line = 0;
+    for (int i = 0; i < code_index; i++)
+    {
+        if (i == 0 || code[i].line != code[i - 1].line || code[i].column != code[i - 1].column)
+        {
+            fprintf(f, "%d %d %d\n", i - last_pc, code[i].line - last_line, code[i].column);
+            last_pc = i;
+            last_line = code[i].line;
+        }
+    }
+    fclose(f);
+}
+
+// Monotonic seconds; 0 without --stats so the hot paths never enter the kernel
+double stats_clock()
+{
+    if (!stats_format)
+        return 0.0;
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// Report phase times and counters (cache_result is "off", "hit" or "miss")
+void print_stats(FILE *out, const char *cache_result)
+{
+    double total = 0.0;
+    for (int p = 0; p < NUM_PHASES; p++)
+        total += stats.seconds[p];
+
+    long num_tokens = 0;
+    for (int t = skipsym; t <= ofsym; t++)
+        num_tokens += stats.tokens[t];
+
+    double avg_probe = stats.symbol_checks > 0 ? (double)stats.symbol_probes / stats.symbol_checks : 0.0;
+
+    struct rusage usage;
+    long peak_kb = getrusage(RUSAGE_SELF, &usage) == 0 ? usage.ru_maxrss : 0;
+
+    if (stats_format == STATS_JSON)
+    {
+        fprintf(out, "{\"program\": \"parsercodegen\", \"cache\": \"%s\", \"phases\": {", cache_result);
+        for (int p = 0; p < NUM_PHASES; p++)
+            fprintf(out, "\"%s\": %.6f, ", phase_names[p], stats.seconds[p]);
+        fprintf(out, "\"total\": %.6f}, \"tokens\": {\"total\": %ld", total, num_tokens);
+        for (int t = skipsym; t <= ofsym; t++)
+        {
+            if (stats.tokens[t] > 0)
+                fprintf(out, ", \"%s\": %ld", token_names[t], stats.tokens[t]);
+        }
+        fprintf(out, "}, \"symbol_table_check\": {\"calls\": %ld, \"average_probe_length\": %.2f}, ",
+                stats.symbol_checks, avg_probe);
+        fprintf(out, "\"emit_calls\": %ld, \"instructions\": %d, ", stats.emits, code_index);
+#ifdef PL0_PIPELINE
+        if (pipeline_path != NULL)
+            fprintf(out, "\"pipeline\": {\"producer_waits\": %ld, \"consumer_waits\": %ld}, ",
+                    token_ring.producer_waits, token_ring.consumer_waits);
+#endif
+        if (perf_mode)
+            print_perf(out, num_tokens);
+        fprintf(out, "\"peak_rss_kb\": %ld}\n", peak_kb);
+        return;
+    }
+
+    fprintf(out, "\nparsercodegen statistics (cache %s):\n", cache_result);
+    fprintf(out, "%-20s %12s\n", "phase", "seconds");
+    for (int p = 0; p < NUM_PHASES; p++)
+        fprintf(out, "%-20s %12.6f\n", phase_names[p], stats.seconds[p]);
+    fprintf(out, "%-20s %12.6f\n", "total", total);
+
+    fprintf(out, "%-20s %12ld\n", "tokens", num_tokens);
+    for (int t = skipsym; t <= ofsym; t++)
+    {
+        if (stats.tokens[t] > 0)
+            fprintf(out, "  %-18s %12ld\n", token_names[t], stats.tokens[t]);
+    }
+    fprintf(out, "%-20s %12ld calls, %.2f average probe length\n", "symbol_table_check",
+            stats.symbol_checks, avg_probe);
+    fprintf(out, "%-20s %12ld calls\n", "emit", stats.emits);
+    fprintf(out, "%-20s %12d\n", "instructions", code_index);
+#ifdef PL0_PIPELINE
+    if (pipeline_path != NULL)
+    {
+        fprintf(out, "%-20s %12ld (ring full)\n", "scanner waits", token_ring.producer_waits);
+        fprintf(out, "%-20s %12ld (ring empty)\n", "parser waits", token_ring.consumer_waits);
+    }
+#endif
+    fprintf(out, "%-20s %12ld KB\n", "peak memory", peak_kb);
+    if (perf_mode)
+        print_perf(out, num_tokens);
+}
+
+// Start a --perf sample (a no-op without --perf or counters)
+void perf_begin()
+{
+    if (perf.opened > 0)
+        perf_read(&perf, perf_start);
+}
+
+// Add the counts since perf_begin to a phase
+void perf_end(phase_id phase)
+{
+    if (perf.opened > 0)
+        perf_add(&perf, perf_start, stats.perf[phase]);
+}
+
+// Counters per phase, their total, and the total per token read and per
+// instruction generated: rows of a table, or a "\"perf\": {...}, " member
+// of the --stats=json object. read and emit are inside parse
+void print_perf(FILE *out, long num_tokens)
+{
+    long long total[PERF_EVENTS];
+    for (int e = 0; e < PERF_EVENTS; e++)
+    {
+        total[e] = -1;
+        for (int p = 0; p < NUM_PHASES; p++)
+        {
+            if (stats.perf[p][e] >= 0)
+                total[e] = (total[e] < 0 ? 0 : total[e]) + stats.perf[p][e];
+        }
+    }
+
+    if (stats_format == STATS_JSON)
+    {
+        if (perf.opened == 0)
+        {
+            fprintf(out, "\"perf\": {\"unavailable\": \"%s\"}, ", perf.reason);
+            return;
+        }
+        fprintf(out, "\"perf\": {\"phases\": {");
+        int first = 1;
+        for (int p = 0; p < NUM_PHASES; p++)
+        {
+            if (p == PHASE_READ || p == PHASE_EMIT)
+                continue;
+            fprintf(out, "%s\"%s\": ", first ? "" : ", ", phase_names[p]);
+            perf_print_json(out, stats.perf[p]);
+            first = 0;
+        }
+        fprintf(out, "}, \"total\": ");
+        perf_print_json(out, total);
+        fprintf(out, ", \"per_token\": ");
+        perf_print_per_json(out, total, num_tokens);
+        fprintf(out, ", \"per_instruction\": ");
+        perf_print_per_json(out, total, code_index);
+        fprintf(out, "}, ");
+        return;
+    }
+
+    if (perf.opened == 0)
+    {
+        fprintf(out, "%-20s unavailable (%s)\n", "counters", perf.reason);
+        return;
+    }
+    perf_print_header(out);
+    for (int p = 0; p < NUM_PHASES; p++)
+    {
+        if (stats.perf[p][PERF_CYCLES] >= 0 || stats.perf[p][PERF_INSTRUCTIONS] >= 0)
+            perf_print_row(out, phase_names[p], stats.perf[p]);
+    }
+    perf_print_row(out, "total", total);
+    perf_print_per_row(out, "per token", total, num_tokens);
+    perf_print_per_row(out, "per instruction", total, code_index);
+}
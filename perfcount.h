@@ -0,0 +1,248 @@
+/*
+Assignment:
+HW3 - Hardware performance counters for lex.c, parsercodegen.c and vm.c (--perf)
+Author(s): Jacob Smith, Jakson Zapata
+Language: C (only)
+
+Notes:
+- Opens cycles, instructions, branch misses, L1 data cache read misses and
+  last-level cache misses for the calling thread with perf_event_open,
+  user space only. Each event is opened on its own, so a CPU or kernel
+  that lacks one (or a VM that exposes none) still counts the rest
+- An event that could not be opened reads as -1 and is printed as "-".
+  When none open, reason says why ("not supported" when the CPU or VM has
+  no such counters, "not permitted" when kernel.perf_event_paranoid
+  forbids them) and the programs run unchanged
+- Counts are scaled by time enabled / time running, so events the kernel
+  multiplexes onto fewer hardware counters give estimates, not zeros
+- inherit also counts threads created after perf_open (vm --batch)
+- The callers sample at the same points --stats reads the clock; a phase
+  costs one read() per event at each end
+- Linux only; elsewhere perf_open fails with "not supported"
+
+Class: COP3402 - System Software - Fall 2025
+Instructor: Dr. Jie Lin
+Due Date: Friday, October 31, 2025 at 11:59 PM ET
+*/
+
+#ifndef PERFCOUNT_H
+#define PERFCOUNT_H
+
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/syscall.h>
+#endif
+
+typedef enum
+{
+    PERF_CYCLES,
+    PERF_INSTRUCTIONS,
+    PERF_BRANCH_MISSES,
+    PERF_L1D_MISSES,
+    PERF_LLC_MISSES,
+    PERF_EVENTS
+} perf_event;
+
+static const char *perf_names[PERF_EVENTS] = {
+    "cycles", "instructions", "branch_misses", "l1d_misses", "llc_misses"};
+
+typedef struct
+{
+    int fd[PERF_EVENTS]; // -1 when the event is not counted
+    int opened;
+    char reason[64]; // why nothing opened
+} perf_counters;
+
+// Open every event for this thread (and, with inherit, its future
+// threads); returns how many opened
+static inline int perf_open(perf_counters *perf, int inherit)
+{
+    perf->opened = 0;
+    for (int e = 0; e < PERF_EVENTS; e++)
+        perf->fd[e] = -1;
+    snprintf(perf->reason, sizeof perf->reason, "not supported");
+
+#ifdef __linux__
+    const struct
+    {
+        unsigned type;
+        unsigned long long config;
+    } events[PERF_EVENTS] = {
+        {PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES},
+        {PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS},
+        {PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES},
+        {PERF_TYPE_HW_CACHE, PERF_COUNT_HW_CACHE_L1D | (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+                                 (PERF_COUNT_HW_CACHE_RESULT_MISS << 16)},
+        {PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES},
+    };
+
+    for (int e = 0; e < PERF_EVENTS; e++)
+    {
+        struct perf_event_attr attr;
+        memset(&attr, 0, sizeof attr);
+        attr.size = sizeof attr;
+        attr.type = events[e].type;
+        attr.config = events[e].config;
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+        attr.inherit = inherit ? 1 : 0;
+        attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+
+        long fd = syscall(SYS_perf_event_open, &attr, 0, -1, -1, PERF_FLAG_FD_CLOEXEC);
+        if (fd >= 0)
+        {
+            perf->fd[e] = (int)fd;
+            perf->opened++;
+        }
+        else if (perf->opened == 0 && (errno == EACCES || errno == EPERM))
+            snprintf(perf->reason, sizeof perf->reason, "not permitted, see kernel.perf_event_paranoid");
+        else if (perf->opened == 0 && errno != ENOENT && errno != ENODEV && errno != EOPNOTSUPP)
+            snprintf(perf->reason, sizeof perf->reason, "%s", strerror(errno));
+    }
+#else
+    (void)inherit;
+#endif
+    return perf->opened;
+}
+
+// Current (scaled) count of every event, -1 for those not counted
+static inline void perf_read(const perf_counters *perf, long long values[PERF_EVENTS])
+{
+    for (int e = 0; e < PERF_EVENTS; e++)
+    {
+        values[e] = -1;
+        unsigned long long data[3]; // value, time enabled, time running
+        if (perf->fd[e] < 0 || read(perf->fd[e], data, sizeof data) != (ssize_t)sizeof data)
+            continue;
+        if (data[2] > 0 && data[2] < data[1])
+            values[e] = (long long)((double)data[0] * data[1] / data[2]);
+        else
+            values[e] = (long long)data[0];
+    }
+}
+
+// Add the counts since start (a perf_read) to total; totals start at -1
+static inline void perf_add(const perf_counters *perf, const long long start[PERF_EVENTS], long long total[PERF_EVENTS])
+{
+    long long now[PERF_EVENTS];
+    perf_read(perf, now);
+    for (int e = 0; e < PERF_EVENTS; e++)
+    {
+        if (now[e] < 0 || start[e] < 0)
+            continue;
+        total[e] = (total[e] < 0 ? 0 : total[e]) + now[e] - start[e];
+    }
+}
+
+static inline void perf_close(perf_counters *perf)
+{
+    for (int e = 0; e < PERF_EVENTS; e++)
+    {
+        if (perf->fd[e] >= 0)
+            close(perf->fd[e]);
+        perf->fd[e] = -1;
+    }
+    perf->opened = 0;
+}
+
+// Instructions per cycle, or -1 when either was not counted
+static inline double perf_ipc(const long long values[PERF_EVENTS])
+{
+    if (values[PERF_CYCLES] <= 0 || values[PERF_INSTRUCTIONS] < 0)
+        return -1.0;
+    return (double)values[PERF_INSTRUCTIONS] / values[PERF_CYCLES];
+}
+
+// Events per unit of work (tokens, VM instructions), or -1
+static inline double perf_per(long long value, long long units)
+{
+    if (value < 0 || units <= 0)
+        return -1.0;
+    return (double)value / units;
+}
+
+// Text report: a header, one row of counts per phase and rows of counts
+// per unit of work; "-" marks what was not counted
+static inline void perf_print_header(FILE *out)
+{
+    fprintf(out, "%-20s %14s %14s %6s %14s %12s %12s\n", "counters", "cycles", "instructions", "IPC",
+            "branch misses", "L1d misses", "LLC misses");
+}
+
+static inline void perf_print_row(FILE *out, const char *label, const long long values[PERF_EVENTS])
+{
+    fprintf(out, "%-20s", label);
+    for (int e = 0; e < PERF_EVENTS; e++)
+    {
+        if (e == PERF_BRANCH_MISSES)
+        {
+            double ipc = perf_ipc(values);
+            if (ipc < 0)
+                fprintf(out, " %6s", "-");
+            else
+                fprintf(out, " %6.2f", ipc);
+        }
+        int width = e < PERF_L1D_MISSES ? 14 : 12;
+        if (values[e] < 0)
+            fprintf(out, " %*s", width, "-");
+        else
+            fprintf(out, " %*lld", width, values[e]);
+    }
+    fprintf(out, "\n");
+}
+
+static inline void perf_print_per_row(FILE *out, const char *label, const long long values[PERF_EVENTS], long long units)
+{
+    fprintf(out, "%-20s", label);
+    for (int e = 0; e < PERF_EVENTS; e++)
+    {
+        if (e == PERF_BRANCH_MISSES)
+            fprintf(out, " %6s", "");
+        int width = e < PERF_L1D_MISSES ? 14 : 12;
+        double per = perf_per(values[e], units);
+        if (per < 0)
+            fprintf(out, " %*s", width, "-");
+        else
+            fprintf(out, " %*.3f", width, per);
+    }
+    fprintf(out, "\n");
+}
+
+// JSON: {"cycles": n, ..., "ipc": x} with null for what was not counted
+static inline void perf_print_json(FILE *out, const long long values[PERF_EVENTS])
+{
+    fprintf(out, "{");
+    for (int e = 0; e < PERF_EVENTS; e++)
+    {
+        if (values[e] < 0)
+            fprintf(out, "\"%s\": null, ", perf_names[e]);
+        else
+            fprintf(out, "\"%s\": %lld, ", perf_names[e], values[e]);
+    }
+    double ipc = perf_ipc(values);
+    if (ipc < 0)
+        fprintf(out, "\"ipc\": null}");
+    else
+        fprintf(out, "\"ipc\": %.3f}", ipc);
+}
+
+// JSON: {"cycles": x, ...} per unit of work
+static inline void perf_print_per_json(FILE *out, const long long values[PERF_EVENTS], long long units)
+{
+    fprintf(out, "{");
+    for (int e = 0; e < PERF_EVENTS; e++)
+    {
+        double per = perf_per(values[e], units);
+        if (per < 0)
+            fprintf(out, "%s\"%s\": null", e > 0 ? ", " : "", perf_names[e]);
+        else
+            fprintf(out, "%s\"%s\": %.4f", e > 0 ? ", " : "", perf_names[e], per);
+    }
+    fprintf(out, "}");
+}
+
+#endif
@@ -0,0 +1,129 @@
+/*
+Assignment:
+HW3 - Token ring shared by lex.c and parsercodegen.c (--pipeline)
+Author(s): Jacob Smith, Jakson Zapata
+Language: C (only)
+
+Notes:
+- Single-producer/single-consumer ring of compact tokens: the scanner
+  thread (lex.c) pushes, the parser thread (parsercodegen.c) pops. Only
+  the producer writes tail and only the consumer writes head, so C11
+  acquire/release atomics are all the synchronization needed
+- Each side keeps a cached copy of the other's index on its own cache
+  line and rereads the shared one only when the ring looks full (or
+  empty), so the two threads rarely touch the same line
+- A full ring blocks the producer (backpressure) and an empty one the
+  consumer: spin briefly, then yield the CPU. Waits are counted for
+  parsercodegen --stats
+- Once the consumer closes the ring, pushes are dropped so the producer
+  can finish without a reader
+
+Class: COP3402 - System Software - Fall 2025
+Instructor: Dr. Jie Lin
+Due Date: Friday, October 31, 2025 at 11:59 PM ET
+*/
+
+#ifndef PIPELINE_H
+#define PIPELINE_H
+
+#include <stdatomic.h>
+#include <stddef.h>
+#include <sched.h>
+
+#ifndef PIPE_CAPACITY // tokens; a power of two (lowered with -D to stress backpressure)
+#define PIPE_CAPACITY 4096
+#endif
+#define PIPE_NAME_LEN 12   // identifier plus terminator
+#define PIPE_SPINS 64      // polls before yielding
+
+// type is a TokenType, 0 for a name definition (value = its id, name set)
+// or -1 for end of input. value is the number or the identifier's id
+typedef struct
+{
+    int type;
+    int value;
+    int line;
+    int column;
+    char name[PIPE_NAME_LEN];
+} pipe_token;
+
+typedef struct
+{
+    // Consumer side
+    _Alignas(64) atomic_size_t head;
+    size_t cached_tail;
+    long consumer_waits;
+
+    // Producer side
+    _Alignas(64) atomic_size_t tail;
+    size_t cached_head;
+    long producer_waits;
+
+    _Alignas(64) atomic_int closed;
+    pipe_token slots[PIPE_CAPACITY];
+} pipe_ring;
+
+static inline void pipe_init(pipe_ring *ring)
+{
+    atomic_init(&ring->head, 0);
+    atomic_init(&ring->tail, 0);
+    atomic_init(&ring->closed, 0);
+    ring->cached_tail = ring->cached_head = 0;
+    ring->consumer_waits = ring->producer_waits = 0;
+}
+
+static inline void pipe_wait(int *spins)
+{
+    if (++*spins >= PIPE_SPINS)
+    {
+        sched_yield();
+        *spins = 0;
+    }
+}
+
+// Producer: copy token into the ring, waiting while it is full
+static inline void pipe_push(pipe_ring *ring, const pipe_token *token)
+{
+    size_t tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+    if (tail - ring->cached_head == PIPE_CAPACITY)
+    {
+        int spins = 0;
+        ring->producer_waits++;
+        for (;;)
+        {
+            if (atomic_load_explicit(&ring->closed, memory_order_relaxed))
+                return;
+            ring->cached_head = atomic_load_explicit(&ring->head, memory_order_acquire);
+            if (tail - ring->cached_head < PIPE_CAPACITY)
+                break;
+            pipe_wait(&spins);
+        }
+    }
+
+    ring->slots[tail & (PIPE_CAPACITY - 1)] = *token;
+    atomic_store_explicit(&ring->tail, tail + 1, memory_order_release);
+}
+
+// Consumer: take the oldest token, waiting while the ring is empty
+static inline void pipe_pop(pipe_ring *ring, pipe_token *token)
+{
+    size_t head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+    if (head == ring->cached_tail)
+    {
+        int spins = 0;
+        ring->consumer_waits++;
+        while ((ring->cached_tail = atomic_load_explicit(&ring->tail, memory_order_acquire)) == head)
+            pipe_wait(&spins);
+    }
+
+    *token = ring->slots[head & (PIPE_CAPACITY - 1)];
+    atomic_store_explicit(&ring->head, head + 1, memory_order_release);
+}
+
+// Consumer: stop reading; later pushes are dropped
+static inline void pipe_close(pipe_ring *ring)
+{
+    atomic_store_explicit(&ring->closed, 1, memory_order_relaxed);
+}
+
+#endif
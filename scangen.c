@@ -0,0 +1,304 @@
+/*
+Assignment:
+HW3 - Scanner table generator for lex.c
+Author(s): Jacob Smith, Jakson Zapata
+Language: C (only)
+
+To Compile:
+gcc -O2 -std=c11 -o scangen scangen.c
+
+To Execute (on Eustis):
+./scangen > scantab.h
+
+Notes:
+- Builds the DFA for every PL/0 token from the specification below (the
+  fixed symbols, the keywords, identifiers, numbers, whitespace and the
+  comment delimiters lex.c reports as tokens) and writes it as C tables
+  for lex.c built with -DLEX_TABLE_SCANNER:
+    scanClass[256]             character -> class
+    scanNext[state][class]     next state, 0 when the character ends the
+                               token, SCAN_MARK set where a new token starts
+    scanAccept[state]          token type for a token ending in that state
+    scanResume[state]          state to continue in after such a token
+- Keywords are paths through the table, so no string compares are left in
+  the scanner; a word that leaves a keyword path continues as identsym
+- Characters with identical columns share a class, which keeps the table
+  to about 3 KB (87 states by 36 classes) instead of 21 KB by raw byte
+- Classification uses the C locale's isspace/isalpha/isdigit, the same
+  predicates lex.c's hand-written scanner uses, so both agree on every byte
+- The token numbering must match TokenType in lex.c; lex.c checks
+  SCAN_LAST_TOKEN against ofsym at compile time
+
+Class: COP3402 - System Software - Fall 2025
+Instructor: Dr. Jie Lin
+Due Date: Friday, October 31, 2025 at 11:59 PM ET
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <ctype.h>
+
+#define MAX_STATES 128 // state numbers share a byte with SCAN_MARK
+#define NUM_CHARS 256
+#define MARK 0x80
+
+// TokenType Enumeration (same numbering as lex.c)
+typedef enum
+{
+    skipsym = 1,
+    identsym,
+    numbersym,
+    plussym,
+    minussym,
+    multsym,
+    slashsym,
+    eqsym,
+    neqsym,
+    lessym,
+    leqsym,
+    gtrsym,
+    geqsym,
+    lparentsym,
+    rparentsym,
+    commasym,
+    semicolonsym,
+    periodsym,
+    becomessym,
+    beginsym,
+    endsym,
+    ifsym,
+    fisym,
+    thensym,
+    whilesym,
+    dosym,
+    callsym,
+    constsym,
+    varsym,
+    procsym,
+    writesym,
+    readsym,
+    elsesym,
+    evensym,
+    casesym,
+    ofsym
+} TokenType;
+
+// Pseudo-tokens for the comment delimiters, each reported as two tokens
+#define COMMENT_OPEN (ofsym + 1)
+#define COMMENT_CLOSE (ofsym + 2)
+
+// Fixed states; trie states for the specification follow
+enum
+{
+    DEAD,
+    START,
+    IDENT,
+    NUMBER,
+    INVALID,
+    COMMENT,
+    COMMENT_STAR,
+    COMMENT_END,
+    FIRST_TRIE_STATE
+};
+
+// Token specification: every fixed lexeme and the type it scans as
+typedef struct
+{
+    const char *text;
+    int type;
+} token_spec;
+
+static const token_spec spec[] = {
+    {"+", plussym},
+    {"-", minussym},
+    {"*", multsym},
+    {"/", slashsym},
+    {"=", eqsym},
+    {"<>", neqsym},
+    {"<", lessym},
+    {"<=", leqsym},
+    {">", gtrsym},
+    {">=", geqsym},
+    {"(", lparentsym},
+    {")", rparentsym},
+    {",", commasym},
+    {";", semicolonsym},
+    {".", periodsym},
+    {":=", becomessym},
+    {"/*", COMMENT_OPEN},
+    {"begin", beginsym},
+    {"end", endsym},
+    {"if", ifsym},
+    {"fi", fisym},
+    {"then", thensym},
+    {"while", whilesym},
+    {"do", dosym},
+    {"call", callsym},
+    {"const", constsym},
+    {"var", varsym},
+    {"procedure", procsym},
+    {"write", writesym},
+    {"read", readsym},
+    {"else", elsesym},
+    {"even", evensym},
+    {"case", casesym},
+    {"of", ofsym},
+};
+
+// The DFA over raw characters, before classes are formed
+int next[MAX_STATES][NUM_CHARS]; // state | MARK
+int accept[MAX_STATES];
+int resume[MAX_STATES];
+int num_states = FIRST_TRIE_STATE;
+
+// Function prototypes
+int new_state(int word);
+void add_spec(const char *text, int type);
+int build_classes(int char_class[NUM_CHARS], int class_rep[NUM_CHARS]);
+void write_table(const int char_class[NUM_CHARS], const int class_rep[NUM_CHARS], int num_classes);
+
+// Main function
+int main()
+{
+    for (int s = 0; s < MAX_STATES; s++)
+        resume[s] = START;
+
+    // Any character starts a token; whitespace just stays in START
+    for (int c = 0; c < NUM_CHARS; c++)
+    {
+        if (isspace(c))
+            next[START][c] = START | MARK;
+        else if (isalpha(c))
+            next[START][c] = IDENT | MARK;
+        else if (isdigit(c))
+            next[START][c] = NUMBER | MARK;
+        else
+            next[START][c] = INVALID | MARK;
+
+        if (isalnum(c))
+            next[IDENT][c] = IDENT;
+        if (isdigit(c))
+            next[NUMBER][c] = NUMBER;
+
+        // Inside a comment only "*/" matters; a "*" may start the closer
+        next[COMMENT][c] = c == '*' ? COMMENT_STAR | MARK : COMMENT;
+        next[COMMENT_STAR][c] = c == '*' ? COMMENT_STAR | MARK : c == '/' ? COMMENT_END : COMMENT;
+    }
+    accept[IDENT] = identsym;
+    accept[NUMBER] = numbersym;
+    accept[INVALID] = skipsym;
+    accept[COMMENT_END] = COMMENT_CLOSE;
+
+    for (size_t i = 0; i < sizeof spec / sizeof spec[0]; i++)
+        add_spec(spec[i].text, spec[i].type);
+
+    int char_class[NUM_CHARS], class_rep[NUM_CHARS];
+    int num_classes = build_classes(char_class, class_rep);
+    write_table(char_class, class_rep, num_classes);
+    return 0;
+}
+
+// A trie state. Word states fall back to identifier scanning; a symbol
+// prefix that is not a token itself (":") is an invalid symbol
+int new_state(int word)
+{
+    if (num_states == MAX_STATES)
+    {
+        fprintf(stderr, "Error: more than %d scanner states\n", MAX_STATES - 1);
+        exit(1);
+    }
+
+    int s = num_states++;
+    if (word)
+    {
+        for (int c = 0; c < NUM_CHARS; c++)
+            next[s][c] = isalnum(c) ? IDENT : DEAD;
+        accept[s] = identsym;
+    }
+    else
+        accept[s] = skipsym;
+    return s;
+}
+
+// Walk text from START, splitting off trie states where the path still
+// shares a generic state (IDENT or INVALID)
+void add_spec(const char *text, int type)
+{
+    int word = isalpha((unsigned char)text[0]);
+    int s = START;
+    for (const char *p = text; *p != '\0'; p++)
+    {
+        int c = (unsigned char)*p;
+        int t = next[s][c] & ~MARK;
+        if (t < FIRST_TRIE_STATE)
+        {
+            t = new_state(word);
+            next[s][c] = t | (next[s][c] & MARK);
+        }
+        s = t;
+    }
+    accept[s] = type;
+    if (type == COMMENT_OPEN)
+        resume[s] = COMMENT;
+}
+
+// Group characters whose columns are identical in every state
+int build_classes(int char_class[NUM_CHARS], int class_rep[NUM_CHARS])
+{
+    int num_classes = 0;
+    for (int c = 0; c < NUM_CHARS; c++)
+    {
+        char_class[c] = -1;
+        for (int k = 0; k < num_classes && char_class[c] < 0; k++)
+        {
+            int same = 1;
+            for (int s = 0; s < num_states && same; s++)
+                same = next[s][c] == next[s][class_rep[k]];
+            if (same)
+                char_class[c] = k;
+        }
+        if (char_class[c] < 0)
+        {
+            class_rep[num_classes] = c;
+            char_class[c] = num_classes++;
+        }
+    }
+    return num_classes;
+}
+
+void write_table(const int char_class[NUM_CHARS], const int class_rep[NUM_CHARS], int num_classes)
+{
+    printf("// Generated by scangen.c; do not edit\n\n");
+    printf("#define SCAN_STATES %d\n", num_states);
+    printf("#define SCAN_CLASSES %d\n", num_classes);
+    printf("#define SCAN_START %d\n", START);
+    printf("#define SCAN_MARK 0x%x\n", MARK);
+    printf("#define SCAN_COMMENT_OPEN %d\n", COMMENT_OPEN);
+    printf("#define SCAN_COMMENT_CLOSE %d\n", COMMENT_CLOSE);
+    printf("#define SCAN_LAST_TOKEN %d\n\n", ofsym);
+
+    printf("static const unsigned char scanClass[256] = {");
+    for (int c = 0; c < NUM_CHARS; c++)
+        printf("%s%d,", c % 16 == 0 ? "\n    " : " ", char_class[c]);
+    printf("\n};\n\n");
+
+    printf("static const unsigned char scanNext[SCAN_STATES][SCAN_CLASSES] = {\n");
+    for (int s = 0; s < num_states; s++)
+    {
+        printf("    {");
+        for (int k = 0; k < num_classes; k++)
+            printf("%s%d", k == 0 ? "" : ", ", next[s][class_rep[k]]);
+        printf("},\n");
+    }
+    printf("};\n\n");
+
+    printf("static const unsigned char scanAccept[SCAN_STATES] = {");
+    for (int s = 0; s < num_states; s++)
+        printf("%s%d", s == 0 ? "" : ", ", accept[s]);
+    printf("};\n\n");
+
+    printf("static const unsigned char scanResume[SCAN_STATES] = {");
+    for (int s = 0; s < num_states; s++)
+        printf("%s%d", s == 0 ? "" : ", ", resume[s]);
+    printf("};\n");
+}
@@ -0,0 +1,1871 @@
+/*
+Assignment:
+HW3 - PM/0 Virtual Machine for parsercodegen output
+Author(s): Jacob Smith, Jakson Zapata
+Language: C (only)
+
+To Compile:
+gcc -O2 -std=c11 -pthread -o vm vm.c
+
+To Execute (on Eustis):
+./vm [--count] [--binary] [--tos] [--perf] [--profile <folded_file>] [--profile-data <profile_file>] [elf_file]
+./vm --batch <list_file> [--jobs <threads>] [--binary] [--tos] [--perf]
+
+where:
+[elf_file] is the code file written by parsercodegen (default elf.txt)
+<folded_file> receives the profile as folded stacks
+<profile_file> receives the profile for parsercodegen --profile-use
+<list_file> names the programs to run, one "elf_file [input [output]]" per line
+
+Notes:
+- Reads one "OP L M" triple per line; CAL/JMP/JPC targets are stored
+  scaled by 3 in elf.txt and are divided back to instruction indices
+- SYS 0 1 prints one integer per line, SYS 0 2 reads one from stdin.
+  Both are buffered 64 KB at a time with their own integer formatting and
+  parsing instead of printf/scanf. Output is flushed at halt, on a runtime
+  error, and before blocking for more input, so prompts still come
+  before the reads that answer them
+- --binary makes SYS 0 1 write and SYS 0 2 read 4-byte little-endian
+  two's-complement integers with no separators, for piping one program
+  into another
+- --count reports the number of instructions executed to stderr; built
+  with -DVM_STACK_TRAFFIC it also reports the stack loads and stores
+- --perf reports hardware counters for the run to stderr (see
+  perfcount.h): cycles, instructions, IPC, and branch, L1d and LLC misses,
+  in total and per VM instruction executed. Loading the program is not
+  counted; with --batch the counts cover every thread. When the machine
+  offers no counters it says so and the program runs as usual
+- --tos runs the top-of-stack caching interpreter (run_cached): the top
+  one or two operands live in registers, so expression code mostly
+  works without touching the stack's memory. Output, errors and
+  instruction counts are the same as without it
+- --profile counts executions per instruction. Every backward JMP is a
+  loop (the back edge statement emits for while) spanning its target up
+  to the JMP. A summary of the hottest opcodes, loops and instructions
+  goes to stderr, and <folded_file> gets one "main;loop@H;...;pc OP count"
+  line per executed instruction for flamegraph.pl and similar tools.
+  Loop frames carry line:col when the matching .lines file from
+  parsercodegen -g sits next to the elf file
+- Profile addresses are scaled by 3 like the jump targets in elf.txt
+- --profile-data writes the stable PL0PROF format read back by
+  parsercodegen --profile-use:
+    PL0PROF 1
+    code <instructions> <FNV-1a of elf.txt as written, hex>
+    total <instructions executed>
+    <pc> <count> <line> <column>    one row per executed instruction
+  pc is an instruction index; line and column are 0 without a .lines file
+- --batch runs every program in <list_file> in one process. All images
+  are loaded and decoded first; the jobs are then dealt round robin onto
+  one Chase-Lev deque per thread (--jobs, default one per online CPU).
+  A thread runs its own jobs newest first and, once its deque is empty,
+  steals the oldest job from the others. Each thread has its own stack
+  (zeroed before every program) and I/O buffers. A program reads its
+  input file (default /dev/null) and writes its output file (default
+  <elf_file>.out); a runtime error ends only that program. stdout gets a
+  line per program in list order (status, instructions executed,
+  seconds, the error if any) and a summary with the total instructions,
+  instructions/sec and the number of steals. The exit status is 1 when
+  any program failed
+- Besides OPR 0-11, OPR 12 (SHL) and 13 (SHR) shift the second operand
+  by the top one (mod 32); SHR rounds toward zero the way DIV does.
+  parsercodegen --simplify emits them for multiplies and divides by 2^k
+- JTB 0 n (opcode 10, parsercodegen's case statement) pops an index and
+  continues at the target of the index-th of the n + 1 JMPs after it, the
+  last one when the index is outside 0..n-1; load_program rejects a JTB
+  whose table is not all there
+- The stack grows upward; an activation record is SL, DL, RA followed
+  by the locals, so variable addresses start at 3 (see var_declaration)
+
+Class: COP3402 - System Software - Fall 2025
+Instructor: Dr. Jie Lin
+Due Date: Friday, October 31, 2025 at 11:59 PM ET
+*/
+
+#define _POSIX_C_SOURCE 200809L
+#define _DEFAULT_SOURCE // syscall() for perfcount.h
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <errno.h>
+#include <limits.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <setjmp.h>
+#include <time.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include "perfcount.h"
+
+#define MAX_STACK_HEIGHT 100000
+#define PROFILE_TOP 10
+#define IO_BUFFER_SIZE 65536
+
+// -DVM_STACK_TRAFFIC counts the stack loads and stores each interpreter
+// performs, for comparing run and run_cached; off, it costs nothing
+#ifdef VM_STACK_TRAFFIC
+#define TRAFFIC(reads, writes) (stack_reads += (reads), stack_writes += (writes))
+#else
+#define TRAFFIC(reads, writes) ((void)0)
+#endif
+
+
+// Instruction structure (matching parsercodegen.c)
+typedef struct
+{
+    int op; // opcode
+    int l;  // lexicographical level
+    int m;  // modifier
+} instruction;
+
+// Program I/O (SYS 0 1 and SYS 0 2): both directions go through a buffer
+// and straight to file descriptors (0 and 1, or a batch job's files),
+// bypassing stdio
+typedef struct
+{
+    int in_fd;
+    int out_fd;
+    char out_buffer[IO_BUFFER_SIZE];
+    size_t out_len;
+    char in_buffer[IO_BUFFER_SIZE];
+    size_t in_pos, in_len;
+} vm_io;
+
+// Machine state
+typedef struct
+{
+    instruction *code;
+    int code_length;
+    int *stack;
+    int stack_size;
+    long long steps; // instructions executed
+    long long *profile; // executions per instruction (--profile only)
+    long long stack_reads, stack_writes; // -DVM_STACK_TRAFFIC only
+    vm_io *io;
+    jmp_buf *abort; // --batch: vm_error records the error and jumps here
+    char error[80];
+} vm_state;
+
+// Backward JMP found by the profiler
+typedef struct
+{
+    int head; // jump target, the first instruction of the loop
+    int back; // the backward JMP
+    long long executed; // instructions executed inside [head, back]
+} loop_range;
+
+// --batch: one line of the list file, its decoded image and its result
+typedef struct
+{
+    char *elf_path;
+    char *input_path;
+    char *output_path;
+    instruction *code; // loaded before any worker starts, then read-only
+    int code_length;
+    int failed;
+    long long steps;
+    double seconds;
+    char error[80];
+} batch_job;
+
+// Chase-Lev work-stealing deque of job indices. Every job is pushed
+// before the workers start, so the array never grows; the owner takes
+// from the bottom and thieves steal from the top
+typedef struct
+{
+    _Alignas(64) atomic_long top;
+    _Alignas(64) atomic_long bottom;
+    int *items;
+} job_deque;
+
+// One batch thread: its deque, its machine (stack and I/O buffers) and
+// the jump buffer vm_error returns to when a program fails
+typedef struct
+{
+    job_deque deque;
+    vm_state vm;
+    vm_io io;
+    jmp_buf abort;
+    long steals;
+    pthread_t thread;
+} batch_worker;
+
+// Program I/O state of the single-program mode
+vm_io console_io;
+int io_binary = 0; // --binary: 4-byte little-endian integers, no text
+int tos_cache = 0;  // --tos: run_cached instead of run
+int perf_mode = 0;  // --perf: hardware counters around execution
+
+// "00" .. "99", two digits per lookup when formatting
+const char digit_pairs[] =
+    "00010203040506070809101112131415161718192021222324252627282930313233343536373839"
+    "40414243444546474849505152535455565758596061626364656667686970717273747576777879"
+    "8081828384858687888990919293949596979899";
+
+// Function prototypes
+void vm_error(vm_state *vm, const char *msg, int pc);
+void io_flush(vm_state *vm);
+int io_fill(vm_state *vm);
+int io_getc(vm_state *vm);
+void io_write(vm_state *vm, int value);
+int io_read(vm_state *vm, int *value);
+int load_program(vm_state *vm, const char *path);
+int base(vm_state *vm, int bp, int l, int pc);
+static inline int address(vm_state *vm, int bp, int l, int m, int pc);
+int shift_right(int a, int k);
+void run(vm_state *vm);
+static inline int binary_op(vm_state *vm, int m, int a, int b, int pc);
+void run_cached(vm_state *vm);
+void execute(vm_state *vm);
+
+// Profiler
+const char *op_names[] = {
+    "", "LIT", "OPR", "LOD", "STO", "CAL", "INC", "JMP", "JPC", "SYS", "JTB"};
+int load_lines(const vm_state *vm, const char *elf_path, int *lines, int *columns);
+int compare_loops(const void *a, const void *b);
+void report_profile(const vm_state *vm, const char *elf_path, const char *folded_path);
+uint64_t code_checksum(const vm_state *vm);
+void write_profile_data(const vm_state *vm, const char *elf_path, const char *profile_path);
+
+// Hardware counters (--perf, see perfcount.h)
+void report_perf(perf_counters *perf, const long long start[PERF_EVENTS], long long steps);
+
+// Batch execution
+batch_job *batch_jobs = NULL;
+int num_jobs = 0;
+batch_worker *batch_workers = NULL;
+int num_workers = 0;
+double now_seconds();
+int read_batch_list(const char *list_path);
+int deque_take(job_deque *deque);
+int deque_steal(job_deque *deque, int *job);
+int next_job(int self);
+void run_job(batch_worker *worker, batch_job *job);
+void *batch_thread(void *arg);
+int run_batch(const char *list_path, int jobs);
+
+// Main function
+int main(int argc, char *argv[])
+{
+    const char *path = "elf.txt";
+    const char *folded_path = NULL;
+    const char *profile_path = NULL;
+    const char *batch_path = NULL;
+    int count = 0;
+    int jobs = 0;
+
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "--count") == 0)
+            count = 1;
+        else if (strcmp(argv[i], "--binary") == 0)
+            io_binary = 1;
+        else if (strcmp(argv[i], "--tos") == 0)
+            tos_cache = 1;
+        else if (strcmp(argv[i], "--perf") == 0)
+            perf_mode = 1;
+        else if (strcmp(argv[i], "--profile") == 0 && i + 1 < argc)
+            folded_path = argv[++i];
+        else if (strcmp(argv[i], "--profile-data") == 0 && i + 1 < argc)
+            profile_path = argv[++i];
+        else if (strcmp(argv[i], "--batch") == 0 && i + 1 < argc)
+            batch_path = argv[++i];
+        else if (strcmp(argv[i], "--jobs") == 0 && i + 1 < argc && atoi(argv[i + 1]) > 0)
+            jobs = atoi(argv[++i]);
+        else if (argv[i][0] == '-')
+        {
+            printf("Usage: ./vm [--count] [--binary] [--tos] [--perf] [--profile <folded_file>] [--profile-data <profile_file>] [elf_file]\n");
+            printf("       ./vm --batch <list_file> [--jobs <threads>] [--binary] [--tos] [--perf]\n");
+            return 1;
+        }
+        else
+            path = argv[i];
+    }
+
+    if (batch_path != NULL)
+    {
+        if (folded_path != NULL || profile_path != NULL)
+        {
+            fprintf(stderr, "Error: --profile and --profile-data take a single program, not --batch\n");
+            return 1;
+        }
+        return run_batch(batch_path, jobs);
+    }
+
+    vm_state vm = {0};
+    if (!load_program(&vm, path))
+        return 1;
+
+    vm.stack_size = MAX_STACK_HEIGHT;
+    vm.stack = calloc((size_t)vm.stack_size, sizeof *vm.stack);
+    if (vm.stack == NULL)
+    {
+        fprintf(stderr, "Error: Out of memory\n");
+        return 1;
+    }
+
+    if (folded_path != NULL || profile_path != NULL)
+    {
+        vm.profile = calloc((size_t)vm.code_length, sizeof *vm.profile);
+        if (vm.profile == NULL)
+        {
+            fprintf(stderr, "Error: Out of memory\n");
+            return 1;
+        }
+    }
+
+    console_io.in_fd = STDIN_FILENO;
+    console_io.out_fd = STDOUT_FILENO;
+    vm.io = &console_io;
+
+    perf_counters perf = {0};
+    long long perf_start[PERF_EVENTS];
+    if (perf_mode && perf_open(&perf, 0) > 0)
+        perf_read(&perf, perf_start);
+
+    execute(&vm);
+    io_flush(&vm);
+
+    if (perf_mode)
+        report_perf(&perf, perf_start, vm.steps);
+
+    if (count)
+    {
+        fprintf(stderr, "instructions executed: %lld\n", vm.steps);
+#ifdef VM_STACK_TRAFFIC
+        fprintf(stderr, "stack reads: %lld, stack writes: %lld\n", vm.stack_reads, vm.stack_writes);
+#endif
+    }
+    if (folded_path != NULL)
+        report_profile(&vm, path, folded_path);
+    if (profile_path != NULL)
+        write_profile_data(&vm, path, profile_path);
+
+    free(vm.code);
+    free(vm.stack);
+    free(vm.profile);
+    return 0;
+}
+
+// Runtime errors stop the machine
+void vm_error(vm_state *vm, const char *msg, int pc)
+{
+    io_flush(vm);
+    if (pc >= 0)
+        snprintf(vm->error, sizeof vm->error, "%s (pc %d)", msg, pc);
+    else
+        snprintf(vm->error, sizeof vm->error, "%s", msg);
+
+    if (vm->abort != NULL)
+        longjmp(*vm->abort, 1);
+    fprintf(stderr, "Error: %s\n", vm->error);
+    exit(1);
+}
+
+// Load elf.txt into vm->code, converting scaled targets back to indices
+int load_program(vm_state *vm, const char *path)
+{
+    FILE *elf = fopen(path, "r");
+    if (!elf)
+    {
+        fprintf(stderr, "Error: Cannot open %s\n", path);
+        return 0;
+    }
+
+    int capacity = 512;
+    vm->code = malloc((size_t)capacity * sizeof *vm->code);
+    vm->code_length = 0;
+
+    int op, l, m;
+    while (vm->code != NULL && fscanf(elf, "%d %d %d", &op, &l, &m) == 3)
+    {
+        if (vm->code_length == capacity)
+        {
+            capacity *= 2;
+            instruction *grown = realloc(vm->code, (size_t)capacity * sizeof *vm->code);
+            if (grown == NULL)
+            {
+                free(vm->code);
+                vm->code = NULL;
+                break;
+            }
+            vm->code = grown;
+        }
+
+        // Scale targets back for CAL (5), JMP (7), JPC (8)
+        if (op == 5 || op == 7 || op == 8)
+            m = m / 3;
+
+        vm->code[vm->code_length].op = op;
+        vm->code[vm->code_length].l = l;
+        vm->code[vm->code_length].m = m;
+        vm->code_length++;
+    }
+    fclose(elf);
+
+    if (vm->code == NULL)
+    {
+        fprintf(stderr, "Error: Out of memory\n");
+        return 0;
+    }
+    if (vm->code_length == 0)
+    {
+        fprintf(stderr, "Error: %s contains no instructions\n", path);
+        return 0;
+    }
+
+    // The interpreters follow a JTB's table without looking, so check
+    // here that its n + 1 entries are all there and all JMPs
+    for (int i = 0; i < vm->code_length; i++)
+    {
+        if (vm->code[i].op != 10)
+            continue;
+        int n = vm->code[i].m;
+        int valid = n >= 0 && n < vm->code_length - i - 1;
+        for (int k = i + 1; valid && k <= i + n + 1; k++)
+            valid = vm->code[k].op == 7;
+        if (!valid)
+        {
+            fprintf(stderr, "Error: %s: malformed jump table at pc %d\n", path, i);
+            return 0;
+        }
+    }
+    return 1;
+}
+
+// Write out everything buffered so far
+void io_flush(vm_state *vm)
+{
+    vm_io *io = vm->io;
+    size_t done = 0;
+    while (done < io->out_len)
+    {
+        ssize_t n = write(io->out_fd, io->out_buffer + done, io->out_len - done);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+        {
+            io->out_len = 0; // vm_error flushes again
+            vm_error(vm, "Cannot write output", -1);
+        }
+        done += (size_t)n;
+    }
+    io->out_len = 0;
+}
+
+// Read the next block of input. Output is flushed first so a prompt
+// written before a read appears before the program waits on it
+int io_fill(vm_state *vm)
+{
+    vm_io *io = vm->io;
+    io_flush(vm);
+    ssize_t n;
+    do
+        n = read(io->in_fd, io->in_buffer, sizeof io->in_buffer);
+    while (n < 0 && errno == EINTR);
+    io->in_pos = 0;
+    io->in_len = n > 0 ? (size_t)n : 0;
+    return io->in_len > 0;
+}
+
+int io_getc(vm_state *vm)
+{
+    vm_io *io = vm->io;
+    if (io->in_pos == io->in_len && !io_fill(vm))
+        return EOF;
+    return (unsigned char)io->in_buffer[io->in_pos++];
+}
+
+// SYS 0 1: one integer per line ("%d\n"), or 4 bytes with --binary
+void io_write(vm_state *vm, int value)
+{
+    vm_io *io = vm->io;
+    if (io->out_len + 12 > sizeof io->out_buffer)
+        io_flush(vm);
+
+    unsigned u = (unsigned)value;
+    if (io_binary)
+    {
+        io->out_buffer[io->out_len++] = (char)(u & 0xff);
+        io->out_buffer[io->out_len++] = (char)((u >> 8) & 0xff);
+        io->out_buffer[io->out_len++] = (char)((u >> 16) & 0xff);
+        io->out_buffer[io->out_len++] = (char)(u >> 24);
+        return;
+    }
+
+    // Digits come out lowest pair first, so fill a scratch buffer backwards
+    char digits[10];
+    int n = sizeof digits;
+    if (value < 0)
+    {
+        io->out_buffer[io->out_len++] = '-';
+        u = 0u - u;
+    }
+    while (u >= 100)
+    {
+        unsigned pair = (u % 100) * 2;
+        u /= 100;
+        digits[--n] = digit_pairs[pair + 1];
+        digits[--n] = digit_pairs[pair];
+    }
+    if (u >= 10)
+    {
+        digits[--n] = digit_pairs[u * 2 + 1];
+        digits[--n] = digit_pairs[u * 2];
+    }
+    else
+        digits[--n] = (char)('0' + u);
+
+    memcpy(io->out_buffer + io->out_len, digits + n, sizeof digits - (size_t)n);
+    io->out_len += sizeof digits - (size_t)n;
+    io->out_buffer[io->out_len++] = '\n';
+}
+
+// SYS 0 2: an optionally signed decimal after any whitespace, as scanf's
+// %d reads it (out-of-range values wrap), or 4 bytes with --binary.
+// Returns 0 when there is no integer
+int io_read(vm_state *vm, int *value)
+{
+    if (io_binary)
+    {
+        unsigned u = 0;
+        for (int i = 0; i < 4; i++)
+        {
+            int ch = io_getc(vm);
+            if (ch == EOF)
+                return 0;
+            u |= (unsigned)ch << (8 * i);
+        }
+        *value = (int)u;
+        return 1;
+    }
+
+    int ch = io_getc(vm);
+    while (ch != EOF && isspace(ch))
+        ch = io_getc(vm);
+
+    int negative = 0;
+    if (ch == '-' || ch == '+')
+    {
+        negative = ch == '-';
+        ch = io_getc(vm);
+    }
+    if (ch == EOF || !isdigit(ch))
+        return 0;
+
+    unsigned u = 0;
+    while (ch != EOF && isdigit(ch))
+    {
+        u = u * 10 + (unsigned)(ch - '0');
+        ch = io_getc(vm);
+    }
+    if (ch != EOF)
+        vm->io->in_pos--; // the character is still in in_buffer
+
+    *value = (int)(negative ? 0u - u : u);
+    return 1;
+}
+
+// Follow static links l levels down. bp is always inside the stack (CAL
+// and RTN keep it there); a link read from it may not be
+int base(vm_state *vm, int bp, int l, int pc)
+{
+    while (l-- > 0)
+    {
+        bp = vm->stack[bp];
+        if ((unsigned)bp >= (unsigned)vm->stack_size)
+            vm_error(vm, "Address out of range", pc);
+    }
+    return bp;
+}
+
+// Stack slot of a LOD or STO. Checked on every access, so a malformed
+// image stops with an error instead of reaching memory past the stack
+// (in --batch, another worker's)
+static inline int address(vm_state *vm, int bp, int l, int m, int pc)
+{
+    unsigned addr = (unsigned)base(vm, bp, l, pc) + (unsigned)m;
+    if (addr >= (unsigned)vm->stack_size)
+        vm_error(vm, "Address out of range", pc);
+    return (int)addr;
+}
+
+// SHR: a / 2^k rounded toward zero, the way DIV rounds (k taken mod 32)
+int shift_right(int a, int k)
+{
+    k &= 31;
+    if (a < 0)
+        return (int)(0u - ((0u - (unsigned)a) >> k));
+    return a >> k;
+}
+
+// Fetch-execute loop; returns on SYS 0 3
+void run(vm_state *vm)
+{
+    instruction *code = vm->code;
+    int *stack = vm->stack;
+    long long *profile = vm->profile;
+    int limit = vm->stack_size;
+    int pc = 0, bp = 0, sp = -1;
+    long long steps = 0;
+#ifdef VM_STACK_TRAFFIC
+    long long stack_reads = 0, stack_writes = 0;
+#endif
+
+    for (;;)
+    {
+        if (pc < 0 || pc >= vm->code_length)
+            vm_error(vm, "Program counter out of range", pc);
+
+        if (profile != NULL)
+            profile[pc]++;
+        instruction ir = code[pc++];
+        steps++;
+
+        switch (ir.op)
+        {
+        case 1: // LIT
+            if (sp + 1 >= limit)
+                vm_error(vm, "Stack overflow", pc - 1);
+            stack[++sp] = ir.m;
+            TRAFFIC(0, 1);
+            break;
+
+        case 2: // OPR
+            if (ir.m == 0)
+            {
+                // RTN
+                int link = stack[bp + 1];
+                if (link < 0 || link >= limit - 2)
+                    vm_error(vm, "Address out of range", pc - 1);
+                sp = bp - 1;
+                pc = stack[bp + 2];
+                bp = link;
+                TRAFFIC(2, 0);
+                break;
+            }
+            if (ir.m == 11)
+            {
+                if (sp < 0)
+                    vm_error(vm, "Stack underflow", pc - 1);
+                stack[sp] = stack[sp] % 2 == 0;
+                TRAFFIC(1, 1);
+                break;
+            }
+            if (sp < 1)
+                vm_error(vm, "Stack underflow", pc - 1);
+            {
+                int a = stack[sp - 1], b = stack[sp];
+                int r;
+                switch (ir.m)
+                {
+                case 1:
+                    r = (int)((unsigned)a + (unsigned)b);
+                    break;
+                case 2:
+                    r = (int)((unsigned)a - (unsigned)b);
+                    break;
+                case 3:
+                    r = (int)((unsigned)a * (unsigned)b);
+                    break;
+                case 4:
+                    if (b == 0)
+                        vm_error(vm, "Division by zero", pc - 1);
+                    r = (a == INT_MIN && b == -1) ? a : a / b;
+                    break;
+                case 5:
+                    r = a == b;
+                    break;
+                case 6:
+                    r = a != b;
+                    break;
+                case 7:
+                    r = a < b;
+                    break;
+                case 8:
+                    r = a <= b;
+                    break;
+                case 9:
+                    r = a > b;
+                    break;
+                case 10:
+                    r = a >= b;
+                    break;
+                case 12:
+                    r = (int)((unsigned)a << (b & 31));
+                    break;
+                case 13:
+                    r = shift_right(a, b);
+                    break;
+                default:
+                    vm_error(vm, "Invalid OPR operation", pc - 1);
+                    return;
+                }
+                stack[--sp] = r;
+                TRAFFIC(2, 1);
+            }
+            break;
+
+        case 3: // LOD
+            if (sp + 1 >= limit)
+                vm_error(vm, "Stack overflow", pc - 1);
+            stack[sp + 1] = stack[address(vm, bp, ir.l, ir.m, pc - 1)];
+            sp++;
+            TRAFFIC(ir.l + 1, 1);
+            break;
+
+        case 4: // STO
+            if (sp < 0)
+                vm_error(vm, "Stack underflow", pc - 1);
+            stack[address(vm, bp, ir.l, ir.m, pc - 1)] = stack[sp--];
+            TRAFFIC(ir.l + 1, 1);
+            break;
+
+        case 5: // CAL
+            if (sp + 3 >= limit)
+                vm_error(vm, "Stack overflow", pc - 1);
+            stack[sp + 1] = base(vm, bp, ir.l, pc - 1);
+            stack[sp + 2] = bp;
+            stack[sp + 3] = pc;
+            bp = sp + 1;
+            pc = ir.m;
+            TRAFFIC(ir.l, 3);
+            break;
+
+        case 6: // INC
+            if (sp + ir.m >= limit)
+                vm_error(vm, "Stack overflow", pc - 1);
+            if (sp + ir.m < -1)
+                vm_error(vm, "Stack underflow", pc - 1);
+            sp += ir.m;
+            break;
+
+        case 7: // JMP
+            pc = ir.m;
+            break;
+
+        case 8: // JPC
+            if (sp < 0)
+                vm_error(vm, "Stack underflow", pc - 1);
+            if (stack[sp--] == 0)
+                pc = ir.m;
+            TRAFFIC(1, 0);
+            break;
+
+        case 9: // SYS
+            if (ir.m == 1)
+            {
+                if (sp < 0)
+                    vm_error(vm, "Stack underflow", pc - 1);
+                io_write(vm, stack[sp--]);
+                TRAFFIC(1, 0);
+            }
+            else if (ir.m == 2)
+            {
+                int value = 0;
+                if (!io_read(vm, &value))
+                    vm_error(vm, "Expected an integer on input", pc - 1);
+                if (sp + 1 >= limit)
+                    vm_error(vm, "Stack overflow", pc - 1);
+                stack[++sp] = value;
+                TRAFFIC(0, 1);
+            }
+            else if (ir.m == 3)
+            {
+                vm->steps = steps;
+#ifdef VM_STACK_TRAFFIC
+                vm->stack_reads = stack_reads;
+                vm->stack_writes = stack_writes;
+#endif
+                return;
+            }
+            else
+                vm_error(vm, "Invalid SYS operation", pc - 1);
+            break;
+
+        case 10: // JTB: straight to the target of the selected table entry
+        {
+            if (sp < 0)
+                vm_error(vm, "Stack underflow", pc - 1);
+            int index = stack[sp--];
+            pc = code[pc + ((unsigned)index < (unsigned)ir.m ? index : ir.m)].m;
+            TRAFFIC(1, 0);
+            break;
+        }
+
+        default:
+            vm_error(vm, "Invalid opcode", pc - 1);
+        }
+    }
+}
+
+// OPR 1-10, 12 and 13 with a below b on the stack, for run_cached
+static inline int binary_op(vm_state *vm, int m, int a, int b, int pc)
+{
+    switch (m)
+    {
+    case 1:
+        return (int)((unsigned)a + (unsigned)b);
+    case 2:
+        return (int)((unsigned)a - (unsigned)b);
+    case 3:
+        return (int)((unsigned)a * (unsigned)b);
+    case 4:
+        if (b == 0)
+            vm_error(vm, "Division by zero", pc);
+        return (a == INT_MIN && b == -1) ? a : a / b;
+    case 5:
+        return a == b;
+    case 6:
+        return a != b;
+    case 7:
+        return a < b;
+    case 8:
+        return a <= b;
+    case 9:
+        return a > b;
+    case 10:
+        return a >= b;
+    case 12:
+        return (int)((unsigned)a << (b & 31));
+    case 13:
+        return shift_right(a, b);
+    default:
+        vm_error(vm, "Invalid OPR operation", pc);
+        return 0;
+    }
+}
+
+// run with the top one or two stack slots kept in t0 and t1 (--tos).
+// sp is the same logical stack pointer as in run, so every bounds check
+// and error is unchanged; only where the top values live differs. There
+// is a dispatch loop per cache depth, each with its own code for every
+// instruction, and instructions move between them as they push and pop:
+// an OPR with both operands cached touches no memory at all. The cache
+// is written back before CAL, INC and RTN, which work on the frame in
+// memory, and a LOD or STO of a slot that is cached goes through the
+// register. One difference remains for hand-written code with procedures
+// (parsercodegen emits none): temporaries that never left the registers
+// are not in the stack's memory afterwards, so a procedure local read
+// before it is assigned can see other leftovers than under run
+void run_cached(vm_state *vm)
+{
+    instruction *code = vm->code;
+    int *stack = vm->stack;
+    long long *profile = vm->profile;
+    int limit = vm->stack_size;
+    int pc = 0, bp = 0, sp = -1;
+    int t0 = 0, t1 = 0;
+    int addr, value;
+    instruction ir;
+    long long steps = 0;
+#ifdef VM_STACK_TRAFFIC
+    long long stack_reads = 0, stack_writes = 0;
+#endif
+
+// Nothing cached: stack[sp] is in memory
+cache0:
+    for (;;)
+    {
+        if (pc < 0 || pc >= vm->code_length)
+            vm_error(vm, "Program counter out of range", pc);
+        if (profile != NULL)
+            profile[pc]++;
+        ir = code[pc++];
+        steps++;
+
+        switch (ir.op)
+        {
+        case 1: // LIT
+            if (sp + 1 >= limit)
+                vm_error(vm, "Stack overflow", pc - 1);
+            sp++;
+            t0 = ir.m;
+            goto cache1;
+
+        case 2: // OPR
+            if (ir.m == 0)
+            {
+            rtn:
+                value = stack[bp + 1];
+                if (value < 0 || value >= limit - 2)
+                    vm_error(vm, "Address out of range", pc - 1);
+                sp = bp - 1;
+                pc = stack[bp + 2];
+                bp = value;
+                TRAFFIC(2, 0);
+                goto cache0;
+            }
+            if (ir.m == 11)
+            {
+                if (sp < 0)
+                    vm_error(vm, "Stack underflow", pc - 1);
+                t0 = stack[sp] % 2 == 0;
+                TRAFFIC(1, 0);
+                goto cache1;
+            }
+            if (sp < 1)
+                vm_error(vm, "Stack underflow", pc - 1);
+            t0 = binary_op(vm, ir.m, stack[sp - 1], stack[sp], pc - 1);
+            sp--;
+            TRAFFIC(2, 0);
+            goto cache1;
+
+        case 3: // LOD
+            if (sp + 1 >= limit)
+                vm_error(vm, "Stack overflow", pc - 1);
+            t0 = stack[address(vm, bp, ir.l, ir.m, pc - 1)];
+            sp++;
+            TRAFFIC(ir.l + 1, 0);
+            goto cache1;
+
+        case 4: // STO
+            if (sp < 0)
+                vm_error(vm, "Stack underflow", pc - 1);
+            stack[address(vm, bp, ir.l, ir.m, pc - 1)] = stack[sp--];
+            TRAFFIC(ir.l + 1, 1);
+            break;
+
+        case 5: // CAL
+        cal:
+            if (sp + 3 >= limit)
+                vm_error(vm, "Stack overflow", pc - 1);
+            stack[sp + 1] = base(vm, bp, ir.l, pc - 1);
+            stack[sp + 2] = bp;
+            stack[sp + 3] = pc;
+            bp = sp + 1;
+            pc = ir.m;
+            TRAFFIC(ir.l, 3);
+            goto cache0;
+
+        case 6: // INC
+        inc:
+            if (sp + ir.m >= limit)
+                vm_error(vm, "Stack overflow", pc - 1);
+            if (sp + ir.m < -1)
+                vm_error(vm, "Stack underflow", pc - 1);
+            sp += ir.m;
+            goto cache0;
+
+        case 7: // JMP
+            pc = ir.m;
+            break;
+
+        case 8: // JPC
+            if (sp < 0)
+                vm_error(vm, "Stack underflow", pc - 1);
+            if (stack[sp--] == 0)
+                pc = ir.m;
+            TRAFFIC(1, 0);
+            break;
+
+        case 9: // SYS
+            if (ir.m == 1)
+            {
+                if (sp < 0)
+                    vm_error(vm, "Stack underflow", pc - 1);
+                io_write(vm, stack[sp--]);
+                TRAFFIC(1, 0);
+                break;
+            }
+            if (ir.m == 2)
+            {
+                if (!io_read(vm, &value))
+                    vm_error(vm, "Expected an integer on input", pc - 1);
+                if (sp + 1 >= limit)
+                    vm_error(vm, "Stack overflow", pc - 1);
+                sp++;
+                t0 = value;
+                goto cache1;
+            }
+            if (ir.m == 3)
+                goto halt;
+            vm_error(vm, "Invalid SYS operation", pc - 1);
+            break;
+
+        case 10: // JTB
+            if (sp < 0)
+                vm_error(vm, "Stack underflow", pc - 1);
+            value = stack[sp--];
+            pc = code[pc + ((unsigned)value < (unsigned)ir.m ? value : ir.m)].m;
+            TRAFFIC(1, 0);
+            break;
+
+        default:
+            vm_error(vm, "Invalid opcode", pc - 1);
+        }
+    }
+
+// t0 holds stack[sp]
+cache1:
+    for (;;)
+    {
+        if (pc < 0 || pc >= vm->code_length)
+            vm_error(vm, "Program counter out of range", pc);
+        if (profile != NULL)
+            profile[pc]++;
+        ir = code[pc++];
+        steps++;
+
+        switch (ir.op)
+        {
+        case 1: // LIT
+            if (sp + 1 >= limit)
+                vm_error(vm, "Stack overflow", pc - 1);
+            sp++;
+            t1 = t0;
+            t0 = ir.m;
+            goto cache2;
+
+        case 2: // OPR
+            if (ir.m == 11)
+            {
+                t0 = t0 % 2 == 0;
+                break;
+            }
+            if (ir.m == 0)
+            {
+                stack[sp] = t0;
+                TRAFFIC(0, 1);
+                goto rtn;
+            }
+            if (sp < 1)
+                vm_error(vm, "Stack underflow", pc - 1);
+            t0 = binary_op(vm, ir.m, stack[sp - 1], t0, pc - 1);
+            sp--;
+            TRAFFIC(1, 0);
+            break;
+
+        case 3: // LOD
+            if (sp + 1 >= limit)
+                vm_error(vm, "Stack overflow", pc - 1);
+            addr = address(vm, bp, ir.l, ir.m, pc - 1);
+            if (addr == sp)
+                value = t0;
+            else
+            {
+                value = stack[addr];
+                TRAFFIC(1, 0);
+            }
+            sp++;
+            t1 = t0;
+            t0 = value;
+            TRAFFIC(ir.l, 0);
+            goto cache2;
+
+        case 4: // STO
+            stack[address(vm, bp, ir.l, ir.m, pc - 1)] = t0;
+            sp--;
+            TRAFFIC(ir.l, 1);
+            goto cache0;
+
+        // CAL and INC work on the frame in memory
+        case 5:
+        case 6:
+            stack[sp] = t0;
+            TRAFFIC(0, 1);
+            if (ir.op == 5)
+                goto cal;
+            goto inc;
+
+        case 7: // JMP
+            pc = ir.m;
+            break;
+
+        case 8: // JPC
+            sp--;
+            if (t0 == 0)
+                pc = ir.m;
+            goto cache0;
+
+        case 9: // SYS
+            if (ir.m == 1)
+            {
+                io_write(vm, t0);
+                sp--;
+                goto cache0;
+            }
+            if (ir.m == 2)
+            {
+                if (!io_read(vm, &value))
+                    vm_error(vm, "Expected an integer on input", pc - 1);
+                if (sp + 1 >= limit)
+                    vm_error(vm, "Stack overflow", pc - 1);
+                sp++;
+                t1 = t0;
+                t0 = value;
+                goto cache2;
+            }
+            if (ir.m == 3)
+                goto halt;
+            vm_error(vm, "Invalid SYS operation", pc - 1);
+            break;
+
+        case 10: // JTB
+            sp--;
+            pc = code[pc + ((unsigned)t0 < (unsigned)ir.m ? t0 : ir.m)].m;
+            goto cache0;
+
+        default:
+            vm_error(vm, "Invalid opcode", pc - 1);
+        }
+    }
+
+// t0 holds stack[sp], t1 holds stack[sp - 1]
+cache2:
+    for (;;)
+    {
+        if (pc < 0 || pc >= vm->code_length)
+            vm_error(vm, "Program counter out of range", pc);
+        if (profile != NULL)
+            profile[pc]++;
+        ir = code[pc++];
+        steps++;
+
+        switch (ir.op)
+        {
+        case 1: // LIT
+            if (sp + 1 >= limit)
+                vm_error(vm, "Stack overflow", pc - 1);
+            stack[sp - 1] = t1;
+            sp++;
+            t1 = t0;
+            t0 = ir.m;
+            TRAFFIC(0, 1);
+            break;
+
+        case 2: // OPR
+            if (ir.m == 11)
+            {
+                t0 = t0 % 2 == 0;
+                break;
+            }
+            if (ir.m == 0)
+            {
+                stack[sp - 1] = t1;
+                stack[sp] = t0;
+                TRAFFIC(0, 2);
+                goto rtn;
+            }
+            if (sp < 1)
+                vm_error(vm, "Stack underflow", pc - 1);
+            t0 = binary_op(vm, ir.m, t1, t0, pc - 1);
+            sp--;
+            goto cache1;
+
+        case 3: // LOD
+            if (sp + 1 >= limit)
+                vm_error(vm, "Stack overflow", pc - 1);
+            addr = address(vm, bp, ir.l, ir.m, pc - 1);
+            if (addr == sp)
+                value = t0;
+            else if (addr == sp - 1)
+                value = t1;
+            else
+            {
+                value = stack[addr];
+                TRAFFIC(1, 0);
+            }
+            stack[sp - 1] = t1;
+            sp++;
+            t1 = t0;
+            t0 = value;
+            TRAFFIC(ir.l, 1);
+            break;
+
+        case 4: // STO
+            addr = address(vm, bp, ir.l, ir.m, pc - 1);
+            stack[addr] = t0;
+            sp--;
+            if (addr != sp)
+                t0 = t1;
+            TRAFFIC(ir.l, 1);
+            goto cache1;
+
+        // CAL and INC work on the frame in memory
+        case 5:
+        case 6:
+            stack[sp - 1] = t1;
+            stack[sp] = t0;
+            TRAFFIC(0, 2);
+            if (ir.op == 5)
+                goto cal;
+            goto inc;
+
+        case 7: // JMP
+            pc = ir.m;
+            break;
+
+        case 8: // JPC
+            value = t0;
+            sp--;
+            t0 = t1;
+            if (value == 0)
+                pc = ir.m;
+            goto cache1;
+
+        case 9: // SYS
+            if (ir.m == 1)
+            {
+                io_write(vm, t0);
+                sp--;
+                t0 = t1;
+                goto cache1;
+            }
+            if (ir.m == 2)
+            {
+                if (!io_read(vm, &value))
+                    vm_error(vm, "Expected an integer on input", pc - 1);
+                if (sp + 1 >= limit)
+                    vm_error(vm, "Stack overflow", pc - 1);
+                stack[sp - 1] = t1;
+                sp++;
+                t1 = t0;
+                t0 = value;
+                TRAFFIC(0, 1);
+                break;
+            }
+            if (ir.m == 3)
+                goto halt;
+            vm_error(vm, "Invalid SYS operation", pc - 1);
+            break;
+
+        case 10: // JTB
+            value = t0;
+            sp--;
+            t0 = t1;
+            pc = code[pc + ((unsigned)value < (unsigned)ir.m ? value : ir.m)].m;
+            goto cache1;
+
+        default:
+            vm_error(vm, "Invalid opcode", pc - 1);
+        }
+    }
+
+halt:
+    vm->steps = steps;
+#ifdef VM_STACK_TRAFFIC
+    vm->stack_reads = stack_reads;
+    vm->stack_writes = stack_writes;
+#endif
+}
+
+// The interpreter --tos selects
+void execute(vm_state *vm)
+{
+    if (tos_cache)
+        run_cached(vm);
+    else
+        run(vm);
+}
+
+// Source positions per instruction from the .lines file next to the elf
+// file (see write_line_table in parsercodegen.c); 0 when there is none or
+// it was written for different code
+int load_lines(const vm_state *vm, const char *elf_path, int *lines, int *columns)
+{
+    int code_length = vm->code_length;
+    char path[4096];
+    snprintf(path, sizeof path, "%s", elf_path);
+    char *dot = strrchr(path, '.');
+    if (dot == NULL || strchr(dot, '/') != NULL)
+        dot = path + strlen(path);
+    snprintf(dot, sizeof path - (size_t)(dot - path), ".lines");
+
+    FILE *f = fopen(path, "r");
+    if (f == NULL)
+        return 0;
+
+    int version, length, rows;
+    unsigned long long checksum;
+    if (fscanf(f, "PL0LINES %d %d %llx %d", &version, &length, &checksum, &rows) != 4 || version != 2 ||
+        length != code_length || checksum != code_checksum(vm))
+    {
+        fclose(f);
+        return 0;
+    }
+
+    // Each row holds from its pc up to the next row's pc
+    int pc = 0, line = 0, column = 0, filled = 0;
+    for (int r = 0; r < rows; r++)
+    {
+        int pc_delta, line_delta, col;
+        // Rows only move forward; a corrupt delta would leave filled
+        // outside the arrays
+        if (fscanf(f, "%d %d %d", &pc_delta, &line_delta, &col) != 3 || pc_delta < 0 ||
+            pc_delta > code_length - pc)
+            break;
+        for (int i = filled; i < pc + pc_delta && i < code_length; i++)
+        {
+            lines[i] = line;
+            columns[i] = column;
+        }
+        filled = pc + pc_delta;
+        pc += pc_delta;
+        line += line_delta;
+        column = col;
+    }
+    for (int i = filled; i < code_length; i++)
+    {
+        lines[i] = line;
+        columns[i] = column;
+    }
+    fclose(f);
+    return 1;
+}
+
+// Outer loops first: earlier head, then the later back edge
+int compare_loops(const void *a, const void *b)
+{
+    const loop_range *x = a, *y = b;
+    if (x->head != y->head)
+        return x->head - y->head;
+    return y->back - x->back;
+}
+
+// Summary to stderr, folded stacks to folded_path
+void report_profile(const vm_state *vm, const char *elf_path, const char *folded_path)
+{
+    int n = vm->code_length;
+    long long *profile = vm->profile;
+    long long total = vm->steps > 0 ? vm->steps : 1;
+
+    int *lines = calloc((size_t)n, sizeof *lines);
+    int *columns = calloc((size_t)n, sizeof *columns);
+    int *order = malloc((size_t)n * sizeof *order);
+    loop_range *loops = malloc((size_t)n * sizeof *loops);
+    if (lines == NULL || columns == NULL || order == NULL || loops == NULL)
+    {
+        fprintf(stderr, "Error: Out of memory\n");
+        exit(1);
+    }
+    int have_lines = load_lines(vm, elf_path, lines, columns);
+
+    // Loops are the backward jumps
+    int num_loops = 0;
+    for (int i = 0; i < n; i++)
+    {
+        if (vm->code[i].op == 7 && vm->code[i].m <= i)
+        {
+            loops[num_loops].head = vm->code[i].m;
+            loops[num_loops].back = i;
+            loops[num_loops].executed = 0;
+            for (int j = vm->code[i].m; j <= i; j++)
+                loops[num_loops].executed += profile[j];
+            num_loops++;
+        }
+    }
+    qsort(loops, (size_t)num_loops, sizeof *loops, compare_loops);
+
+    // Per opcode
+    long long by_op[11] = {0};
+    for (int i = 0; i < n; i++)
+    {
+        if (vm->code[i].op >= 1 && vm->code[i].op <= 10)
+            by_op[vm->code[i].op] += profile[i];
+    }
+
+    fprintf(stderr, "\nProfile: %lld instructions executed\n", vm->steps);
+    fprintf(stderr, "\nOpcode   Count         %%\n");
+    for (int op = 1; op <= 10; op++)
+    {
+        if (by_op[op] > 0)
+            fprintf(stderr, "%-8s %-12lld %5.1f\n", op_names[op], by_op[op], 100.0 * by_op[op] / total);
+    }
+
+    // Top loops by dynamic instruction count (selection over a copy of the order)
+    for (int i = 0; i < num_loops; i++)
+        order[i] = i;
+    fprintf(stderr, "\nLoop  Head  Back  Iterations   Instructions      %%  Source\n");
+    for (int k = 0; k < num_loops && k < PROFILE_TOP; k++)
+    {
+        int best = k;
+        for (int i = k + 1; i < num_loops; i++)
+        {
+            if (loops[order[i]].executed > loops[order[best]].executed)
+                best = i;
+        }
+        int tmp = order[k];
+        order[k] = order[best];
+        order[best] = tmp;
+
+        const loop_range *lp = &loops[order[k]];
+        if (lp->executed == 0)
+            break;
+        fprintf(stderr, "%-5d %-5d %-5d %-12lld %-14lld %5.1f", k + 1, lp->head * 3, lp->back * 3,
+                profile[lp->back], lp->executed, 100.0 * lp->executed / total);
+        if (have_lines)
+            fprintf(stderr, "  %d:%d", lines[lp->head], columns[lp->head]);
+        fprintf(stderr, "\n");
+    }
+
+    // Top instructions
+    for (int i = 0; i < n; i++)
+        order[i] = i;
+    fprintf(stderr, "\nPC    OP  L M      Count         %%\n");
+    for (int k = 0; k < n && k < PROFILE_TOP; k++)
+    {
+        int best = k;
+        for (int i = k + 1; i < n; i++)
+        {
+            if (profile[order[i]] > profile[order[best]])
+                best = i;
+        }
+        int tmp = order[k];
+        order[k] = order[best];
+        order[best] = tmp;
+
+        const instruction *ir = &vm->code[order[k]];
+        if (profile[order[k]] == 0)
+            break;
+        int m = (ir->op == 5 || ir->op == 7 || ir->op == 8) ? ir->m * 3 : ir->m;
+        fprintf(stderr, "%-5d %-3s %d %-6d %-13lld %5.1f\n", order[k] * 3, op_names[ir->op], ir->l, m,
+                profile[order[k]], 100.0 * profile[order[k]] / total);
+    }
+
+    // Folded stacks: main, then every loop containing the pc, outermost first
+    FILE *folded = fopen(folded_path, "w");
+    if (folded == NULL)
+    {
+        fprintf(stderr, "Error: Cannot create %s\n", folded_path);
+    }
+    else
+    {
+        for (int i = 0; i < n; i++)
+        {
+            if (profile[i] == 0)
+                continue;
+            fprintf(folded, "main");
+            for (int l = 0; l < num_loops && loops[l].head <= i; l++)
+            {
+                if (i > loops[l].back)
+                    continue;
+                if (have_lines)
+                    fprintf(folded, ";loop@%d (%d:%d)", loops[l].head * 3, lines[loops[l].head], columns[loops[l].head]);
+                else
+                    fprintf(folded, ";loop@%d", loops[l].head * 3);
+            }
+            fprintf(folded, ";%d %s %lld\n", i * 3, op_names[vm->code[i].op], profile[i]);
+        }
+        fclose(folded);
+    }
+
+    free(lines);
+    free(columns);
+    free(order);
+    free(loops);
+}
+
+// FNV-1a over the program exactly as elf.txt spells it, so parsercodegen
+// can tell whether a profile was taken from the code it is about to emit
+uint64_t code_checksum(const vm_state *vm)
+{
+    uint64_t hash = 0xcbf29ce484222325ULL;
+    char text[64];
+    for (int i = 0; i < vm->code_length; i++)
+    {
+        const instruction *ir = &vm->code[i];
+        int m = (ir->op == 5 || ir->op == 7 || ir->op == 8) ? ir->m * 3 : ir->m;
+        int len = snprintf(text, sizeof text, "%d %d %d\n", ir->op, ir->l, m);
+        for (int k = 0; k < len; k++)
+        {
+            hash ^= (unsigned char)text[k];
+            hash *= 0x100000001b3ULL;
+        }
+    }
+    return hash;
+}
+
+// Execution counts in the PL0PROF format (see Notes)
+void write_profile_data(const vm_state *vm, const char *elf_path, const char *profile_path)
+{
+    int n = vm->code_length;
+    int *lines = calloc((size_t)n, sizeof *lines);
+    int *columns = calloc((size_t)n, sizeof *columns);
+    if (lines == NULL || columns == NULL)
+    {
+        fprintf(stderr, "Error: Out of memory\n");
+        exit(1);
+    }
+    load_lines(vm, elf_path, lines, columns);
+
+    FILE *f = fopen(profile_path, "w");
+    if (f == NULL)
+    {
+        fprintf(stderr, "Error: Cannot create %s\n", profile_path);
+    }
+    else
+    {
+        fprintf(f, "PL0PROF 1\ncode %d %016llx\ntotal %lld\n", n,
+                (unsigned long long)code_checksum(vm), vm->steps);
+        for (int i = 0; i < n; i++)
+        {
+            if (vm->profile[i] > 0)
+                fprintf(f, "%d %lld %d %d\n", i, vm->profile[i], lines[i], columns[i]);
+        }
+        fclose(f);
+    }
+
+    free(lines);
+    free(columns);
+}
+
+// --perf: counts since start (every thread's, for --batch), IPC, and
+// events per VM instruction executed, to stderr
+void report_perf(perf_counters *perf, const long long start[PERF_EVENTS], long long steps)
+{
+    if (perf->opened == 0)
+    {
+        fprintf(stderr, "%-20s unavailable (%s)\n", "counters", perf->reason);
+        return;
+    }
+
+    long long counts[PERF_EVENTS];
+    for (int e = 0; e < PERF_EVENTS; e++)
+        counts[e] = -1;
+    perf_add(perf, start, counts);
+    perf_close(perf);
+
+    fprintf(stderr, "%-20s %14lld\n", "vm instructions", steps);
+    perf_print_header(stderr);
+    perf_print_row(stderr, "execute", counts);
+    perf_print_per_row(stderr, "per vm instruction", counts, steps);
+}
+
+double now_seconds()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+// One job per line: "elf_file [input_file [output_file]]". Blank lines and
+// lines starting with # are skipped. Input defaults to /dev/null and
+// output to the elf file's name with .out appended
+int read_batch_list(const char *list_path)
+{
+    FILE *list = fopen(list_path, "r");
+    if (list == NULL)
+    {
+        fprintf(stderr, "Error: Cannot open %s\n", list_path);
+        return 0;
+    }
+
+    int capacity = 64;
+    batch_jobs = malloc((size_t)capacity * sizeof *batch_jobs);
+    char line[3 * 4096 + 16];
+    char elf[4096], input[4096], output[4096];
+    while (batch_jobs != NULL && fgets(line, sizeof line, list) != NULL)
+    {
+        int fields = sscanf(line, "%4095s %4095s %4095s", elf, input, output);
+        if (fields < 1 || elf[0] == '#')
+            continue;
+        if (fields < 2)
+            strcpy(input, "/dev/null");
+        if (fields < 3)
+            snprintf(output, sizeof output, "%.4091s.out", elf);
+
+        if (num_jobs == capacity)
+        {
+            capacity *= 2;
+            batch_job *grown = realloc(batch_jobs, (size_t)capacity * sizeof *batch_jobs);
+            if (grown == NULL)
+            {
+                free(batch_jobs);
+                batch_jobs = NULL;
+                break;
+            }
+            batch_jobs = grown;
+        }
+
+        batch_job *job = &batch_jobs[num_jobs++];
+        memset(job, 0, sizeof *job);
+        job->elf_path = strdup(elf);
+        job->input_path = strdup(input);
+        job->output_path = strdup(output);
+        if (job->elf_path == NULL || job->input_path == NULL || job->output_path == NULL)
+        {
+            free(batch_jobs);
+            batch_jobs = NULL;
+        }
+    }
+    fclose(list);
+
+    if (batch_jobs == NULL)
+    {
+        fprintf(stderr, "Error: Out of memory\n");
+        return 0;
+    }
+    if (num_jobs == 0)
+    {
+        fprintf(stderr, "Error: %s lists no programs\n", list_path);
+        return 0;
+    }
+    return 1;
+}
+
+// Owner: the newest job, or -1 once the deque is empty. Only the last
+// job can race with a thief, and the CAS on top decides who gets it
+int deque_take(job_deque *deque)
+{
+    long b = atomic_load_explicit(&deque->bottom, memory_order_relaxed) - 1;
+    atomic_store_explicit(&deque->bottom, b, memory_order_relaxed);
+    atomic_thread_fence(memory_order_seq_cst);
+    long t = atomic_load_explicit(&deque->top, memory_order_relaxed);
+
+    if (t > b)
+    {
+        atomic_store_explicit(&deque->bottom, b + 1, memory_order_relaxed);
+        return -1;
+    }
+
+    int job = deque->items[b];
+    if (t == b)
+    {
+        if (!atomic_compare_exchange_strong_explicit(&deque->top, &t, t + 1,
+                                                     memory_order_seq_cst, memory_order_relaxed))
+            job = -1;
+        atomic_store_explicit(&deque->bottom, b + 1, memory_order_relaxed);
+    }
+    return job;
+}
+
+// Thief: the oldest job. Returns 1 with *job set, 0 when the deque is
+// empty, -1 when another thread won the race and it is worth retrying
+int deque_steal(job_deque *deque, int *job)
+{
+    long t = atomic_load_explicit(&deque->top, memory_order_acquire);
+    atomic_thread_fence(memory_order_seq_cst);
+    long b = atomic_load_explicit(&deque->bottom, memory_order_acquire);
+    if (t >= b)
+        return 0;
+
+    int stolen = deque->items[t];
+    if (!atomic_compare_exchange_strong_explicit(&deque->top, &t, t + 1,
+                                                 memory_order_seq_cst, memory_order_relaxed))
+        return -1;
+    *job = stolen;
+    return 1;
+}
+
+// The next job for worker self: its own first, then one stolen from the
+// others, starting with its neighbour. No job is ever pushed once the
+// workers run, so a pass that finds every deque empty means all work is
+// taken; -1 then
+int next_job(int self)
+{
+    batch_worker *worker = &batch_workers[self];
+    int job = deque_take(&worker->deque);
+    if (job >= 0)
+        return job;
+
+    for (;;)
+    {
+        int contended = 0;
+        for (int k = 1; k < num_workers; k++)
+        {
+            int r = deque_steal(&batch_workers[(self + k) % num_workers].deque, &job);
+            if (r > 0)
+            {
+                worker->steals++;
+                return job;
+            }
+            if (r < 0)
+                contended = 1;
+        }
+        if (!contended)
+            return -1;
+    }
+}
+
+// Run one program on the worker's machine, recording the outcome in job
+void run_job(batch_worker *worker, batch_job *job)
+{
+    vm_state *vm = &worker->vm;
+    vm_io *io = &worker->io;
+    double start = now_seconds();
+
+    io->in_fd = open(job->input_path, O_RDONLY);
+    io->out_fd = open(job->output_path, O_WRONLY | O_CREAT | O_TRUNC, 0666);
+    io->out_len = io->in_pos = io->in_len = 0;
+    if (io->in_fd < 0 || io->out_fd < 0)
+    {
+        job->failed = 1;
+        snprintf(job->error, sizeof job->error, "Cannot open %s",
+                 io->in_fd < 0 ? job->input_path : job->output_path);
+    }
+    else
+    {
+        // A fresh machine each time: the stack starts zeroed, as calloc
+        // leaves it in single-program mode
+        vm->code = job->code;
+        vm->code_length = job->code_length;
+        vm->steps = 0;
+        memset(vm->stack, 0, (size_t)vm->stack_size * sizeof *vm->stack);
+
+        if (setjmp(worker->abort) == 0)
+        {
+            execute(vm);
+            io_flush(vm);
+            job->steps = vm->steps;
+        }
+        else
+        {
+            job->failed = 1;
+            snprintf(job->error, sizeof job->error, "%s", vm->error);
+        }
+    }
+
+    if (io->in_fd >= 0)
+        close(io->in_fd);
+    if (io->out_fd >= 0)
+        close(io->out_fd);
+    job->seconds = now_seconds() - start;
+}
+
+void *batch_thread(void *arg)
+{
+    batch_worker *worker = arg;
+    int self = (int)(worker - batch_workers);
+    int job;
+    while ((job = next_job(self)) >= 0)
+        run_job(worker, &batch_jobs[job]);
+    return NULL;
+}
+
+// --batch: load and decode every program up front, deal the jobs round
+// robin onto one deque per worker, run them all, then print a line per
+// program in list order and the totals
+int run_batch(const char *list_path, int jobs)
+{
+    if (!read_batch_list(list_path))
+        return 1;
+
+    double load_start = now_seconds();
+    int *runnable = malloc((size_t)num_jobs * sizeof *runnable);
+    if (runnable == NULL)
+    {
+        fprintf(stderr, "Error: Out of memory\n");
+        return 1;
+    }
+    int num_runnable = 0;
+    for (int i = 0; i < num_jobs; i++)
+    {
+        vm_state image = {0};
+        if (load_program(&image, batch_jobs[i].elf_path))
+        {
+            batch_jobs[i].code = image.code;
+            batch_jobs[i].code_length = image.code_length;
+            runnable[num_runnable++] = i;
+        }
+        else
+        {
+            free(image.code);
+            batch_jobs[i].failed = 1;
+            snprintf(batch_jobs[i].error, sizeof batch_jobs[i].error, "Cannot load program");
+        }
+    }
+    double load_seconds = now_seconds() - load_start;
+
+    num_workers = jobs > 0 ? jobs : (int)sysconf(_SC_NPROCESSORS_ONLN);
+    if (num_workers > num_runnable)
+        num_workers = num_runnable;
+    if (num_workers < 1)
+        num_workers = 1;
+
+    batch_workers = calloc((size_t)num_workers, sizeof *batch_workers);
+    if (batch_workers == NULL)
+    {
+        fprintf(stderr, "Error: Out of memory\n");
+        return 1;
+    }
+    for (int w = 0; w < num_workers; w++)
+    {
+        batch_worker *worker = &batch_workers[w];
+        worker->deque.items = malloc(((size_t)num_runnable / (size_t)num_workers + 1) * sizeof *worker->deque.items);
+        worker->vm.stack_size = MAX_STACK_HEIGHT;
+        worker->vm.stack = malloc((size_t)worker->vm.stack_size * sizeof *worker->vm.stack);
+        worker->vm.io = &worker->io;
+        worker->vm.abort = &worker->abort;
+        if (worker->deque.items == NULL || worker->vm.stack == NULL)
+        {
+            fprintf(stderr, "Error: Out of memory\n");
+            return 1;
+        }
+        atomic_init(&worker->deque.top, 0);
+        atomic_init(&worker->deque.bottom, 0);
+    }
+    for (int i = 0; i < num_runnable; i++)
+    {
+        job_deque *deque = &batch_workers[i % num_workers].deque;
+        long b = atomic_load_explicit(&deque->bottom, memory_order_relaxed);
+        deque->items[b] = runnable[i];
+        atomic_store_explicit(&deque->bottom, b + 1, memory_order_relaxed);
+    }
+
+    // Worker 0 is this thread; counters opened here follow the others
+    perf_counters perf = {0};
+    long long perf_start[PERF_EVENTS];
+    if (perf_mode && perf_open(&perf, 1) > 0)
+        perf_read(&perf, perf_start);
+
+    double start = now_seconds();
+    for (int w = 1; w < num_workers; w++)
+    {
+        if (pthread_create(&batch_workers[w].thread, NULL, batch_thread, &batch_workers[w]) != 0)
+        {
+            fprintf(stderr, "Error: Cannot start thread %d\n", w);
+            return 1;
+        }
+    }
+    batch_thread(&batch_workers[0]);
+    for (int w = 1; w < num_workers; w++)
+        pthread_join(batch_workers[w].thread, NULL);
+    double wall = now_seconds() - start;
+
+    long long total = 0;
+    long steals = 0;
+    int failures = 0;
+    printf("%-40s %-7s %-14s %s\n", "Program", "Status", "Instructions", "Seconds");
+    for (int i = 0; i < num_jobs; i++)
+    {
+        const batch_job *job = &batch_jobs[i];
+        if (job->failed)
+        {
+            failures++;
+            printf("%-40s %-7s %-14s %-10.6f %s\n", job->elf_path, "error", "-", job->seconds, job->error);
+        }
+        else
+        {
+            total += job->steps;
+            printf("%-40s %-7s %-14lld %.6f\n", job->elf_path, "ok", job->steps, job->seconds);
+        }
+    }
+    for (int w = 0; w < num_workers; w++)
+        steals += batch_workers[w].steals;
+
+    printf("\nprograms %d, failed %d, threads %d, instructions %lld, load %.3f s, run %.3f s, %.0f instructions/sec, steals %ld\n",
+           num_jobs, failures, num_workers, total, load_seconds, wall,
+           wall > 0 ? (double)total / wall : 0.0, steals);
+    if (perf_mode)
+        report_perf(&perf, perf_start, total);
+
+    for (int i = 0; i < num_jobs; i++)
+    {
+        free(batch_jobs[i].elf_path);
+        free(batch_jobs[i].input_path);
+        free(batch_jobs[i].output_path);
+        free(batch_jobs[i].code);
+    }
+    for (int w = 0; w < num_workers; w++)
+    {
+        free(batch_workers[w].deque.items);
+        free(batch_workers[w].vm.stack);
+    }
+    free(batch_workers);
+    free(batch_jobs);
+    free(runnable);
+    return failures > 0;
+}